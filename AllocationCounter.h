@@ -0,0 +1,55 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_ALLOCATIONCOUNTER_H
+#define HELLOWORLD_ALLOCATIONCOUNTER_H
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Counters of heap allocations of the whole program
+ *
+ * Counters are increased only if the program replaces global operator new and calls AllocationCounter::Count
+ * from it (see CountingNew.h), otherwise they stay zero and IsInstalled is false
+ */
+class AllocationCounter {
+public:
+    static void Count(size_t bytes) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /**
+     * Marks counters as valid, called by the replaced operator new at static initialization
+     * @return true
+     */
+    static bool Install() {
+        installed = true;
+        return true;
+    }
+
+    static bool IsInstalled() {
+        return installed;
+    }
+
+    static uint64_t Allocations() {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t AllocatedBytes() {
+        return allocated_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    inline static std::atomic<bool> installed{false};
+    inline static std::atomic<uint64_t> allocations{0};
+    inline static std::atomic<uint64_t> allocated_bytes{0};
+};
+
+
+#endif //HELLOWORLD_ALLOCATIONCOUNTER_H
@@ -0,0 +1,113 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_ARENA_H
+#define HELLOWORLD_ARENA_H
+
+#pragma once
+
+#include <memory_resource>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Memory of one solve for std::pmr containers
+ *
+ * Allocations are taken from a monotonic buffer, deallocation does nothing,
+ * and all memory is returned to the heap at once, when the arena is destroyed.
+ * Reset drops all allocations, but keeps the first block of memory and grows it to fit the last use,
+ * so an arena reused for solves of similar size stops taking memory from the heap.
+ * Counts allocations made through it, so SolveStats reports them without replacing operator new.
+ * Not thread-safe: containers on one arena must be used by one thread at a time.
+ */
+class Arena : public std::pmr::memory_resource {
+public:
+    explicit Arena(size_t initial_size = INITIAL_SIZE) {
+        Allocate(initial_size);
+    }
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * Drops all allocations, containers on the arena must be destroyed before
+     */
+    void Reset() {
+        if (used > storage_size) {
+            Allocate(std::max(2 * storage_size, used));
+        } else {
+            buffer.emplace(storage.get(), storage_size, std::pmr::new_delete_resource());
+        }
+        used = 0;
+    }
+
+    /**
+     * @return size of the first block of memory, which fits all allocations since the last Reset
+     */
+    size_t Capacity() const {
+        return std::max(storage_size, used);
+    }
+
+    /**
+     * Grows the first block of memory to at least size bytes, drops all allocations as Reset
+     */
+    void Reserve(size_t size) {
+        if (size > storage_size) {
+            Allocate(size);
+            used = 0;
+        } else {
+            Reset();
+        }
+    }
+
+    uint64_t Allocations() const {
+        return allocations;
+    }
+
+    uint64_t AllocatedBytes() const {
+        return allocated_bytes;
+    }
+
+private:
+    const static size_t INITIAL_SIZE = 1 << 16;
+
+    /**
+     * Replaces the first block of memory with a new one of size bytes
+     */
+    void Allocate(size_t size) {
+        buffer.reset();
+        storage.reset(new std::byte[size]);
+        storage_size = size;
+        buffer.emplace(storage.get(), storage_size, std::pmr::new_delete_resource());
+    }
+
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        allocations++;
+        allocated_bytes += bytes;
+        used += bytes + alignment;
+        return buffer->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {
+        // memory is released with the whole arena
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    std::unique_ptr<std::byte[]> storage; // the first block of memory, kept by Reset
+    size_t storage_size = 0;
+    size_t used = 0; // bytes taken since the last Reset, with padding for alignment
+    std::optional<std::pmr::monotonic_buffer_resource> buffer;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+};
+
+
+#endif //HELLOWORLD_ARENA_H
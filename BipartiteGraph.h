@@ -12,6 +12,9 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cassert>
+#include <algorithm>
+#include <limits>
+#include "IndexArray.h"
 
 using std::vector;
 using std::pair;
@@ -20,9 +23,71 @@ using std::unordered_set;
 using std::cout;
 using std::endl;
 
-class BipartiteGraph {
+/**
+ * Bipartite graph in compressed sparse rows with maximum (Hopcroft-Karp) and greedy matchings
+ * Index - type of vertexes of second part and of infos in edges and matching arrays (see IndexArray.h),
+ * it must fit both parts, indexes of edges are int
+ */
+template<typename Index>
+class BasicBipartiteGraph {
 public:
-    BipartiteGraph() = default;
+    /**
+     * Counters of the last call of FindOptimalMatching or FindGreedyMatching
+     */
+    struct MatchingStats {
+        long long initial_matched = 0; // edges in matching found by FindAnyMatching (or FindKarpSipserMatching)
+        long long reductions = 0; // edges of initial matching taken at vertexes of degree one (Karp-Sipser)
+        long long phases = 0; // phases of Hopcroft-Karp
+        long long augmentations = 0; // augmenting paths found
+        long long visits = 0; // vertexes pushed on the stack of depth-first search
+    };
+
+    /**
+     * Edge to second part, vertex_info is stored by ToIndex, -1 - no info
+     */
+    struct Edge {
+        Edge() = default;
+
+        Edge(int second_vertex, int vertex_info)
+                : second_vertex(second_vertex), vertex_info(ToIndex<Index>(vertex_info)) {}
+
+        int VertexInfo() const {
+            return FromIndex(vertex_info);
+        }
+
+        Index second_vertex;
+        Index vertex_info;
+    };
+
+    BasicBipartiteGraph() = default;
+
+    /**
+     * Creates graph from ready compressed sparse rows instead of AddEdge
+     * @param offsets - edges of vertex v from first part are adjacency[offsets[v]..offsets[v + 1])
+     */
+    static BasicBipartiteGraph FromAdjacency(int first_part_size, int second_part_size,
+                                             vector<int> offsets, vector<Edge> adjacency) {
+        assert(static_cast<int>(offsets.size()) == first_part_size + 1);
+        BasicBipartiteGraph graph;
+        graph.first_part_size = first_part_size;
+        graph.second_part_size = second_part_size;
+        graph.offsets = std::move(offsets);
+        graph.adjacency = std::move(adjacency);
+        return graph;
+    }
+
+    /**
+     * Replaces graph with ready compressed sparse rows, as FromAdjacency
+     * Arrays are swapped, so offsets and adjacency get memory of the previous graph to be reused
+     */
+    void Assign(int first_part_size, int second_part_size, vector<int> &offsets, vector<Edge> &adjacency) {
+        assert(static_cast<int>(offsets.size()) == first_part_size + 1);
+        added_edges.clear();
+        this->first_part_size = first_part_size;
+        this->second_part_size = second_part_size;
+        this->offsets.swap(offsets);
+        this->adjacency.swap(adjacency);
+    }
 
     /**
      * Adds edge to bipartite graph
@@ -31,94 +96,360 @@ public:
      * @param info - info about vertexes from first part
      */
     void AddEdge(int first_vertex, int second_vertex, int vertex_info = -1) {
-        if (edges.find(first_vertex) == edges.end()) {
-            edges.emplace(first_vertex, unordered_set<int>());
-        }
-        edges.find(first_vertex)->second.emplace(second_vertex);
-
-        if (info.find(first_vertex) == info.end()) {
-            info.emplace(first_vertex, unordered_map<int, int>());
-        }
-        info.find(first_vertex)->second.emplace(second_vertex, vertex_info);
+        added_edges.push_back({first_vertex, second_vertex, vertex_info});
+        first_part_size = std::max(first_part_size, first_vertex + 1);
+        second_part_size = std::max(second_part_size, second_vertex + 1);
     }
 
     /**
-     * @return unordered_map, which includes optimum matching in bipartite graph
-     * key in unordered_map: vertex in second part, value - vertex in first part which is matched with it
+     * @return vector, which includes optimum matching in bipartite graph
+     * first: vertex in second part, second: vertex in first part which is matched with it
      * and info about it
      *
-     * Method uses Kuhn algorithm, with finding any matching before main algorithm (optimization)
+     * Method uses Hopcroft-Karp algorithm, with finding any matching before main algorithm (optimization)
      */
-    unordered_map<int, pair<int, int>> FindOptimalMatching() {
-        unordered_set<int> used_in_find_any_matching;
-        unordered_set<int> used;
-        unordered_map<int, int> matching = FindAnyMatching(used_in_find_any_matching);
+    vector<pair<int, pair<int, int>>> FindOptimalMatching() {
+        vector<pair<int, pair<int, int>>> result;
+        FindOptimalMatching(result);
+        return result;
+    }
 
-        for (const auto &first_part_vertex: edges) {
-            if (used_in_find_any_matching.find(first_part_vertex.first) == used_in_find_any_matching.end()) {
-                TryFindAugmentingPath(first_part_vertex.first, used, matching);
+    /**
+     * Same as above, but writes matching to result, reusing its memory
+     */
+    void FindOptimalMatching(vector<pair<int, pair<int, int>>> &result) {
+        FindMatching(result, false, std::numeric_limits<long long>::max());
+    }
+
+    /**
+     * Maximal, but not always maximum, matching in time O(n + m) for any fixed max_phases
+     * @param max_phases - phases of Hopcroft-Karp after the initial matching, each is O(n + m)
+     * @param result - same as in FindOptimalMatching
+     *
+     * Initial matching is found by FindAnyMatching, and if it leaves some vertex of first part with edges free,
+     * by Karp-Sipser heuristic, which takes edges at vertexes of degree one first, so it is maximum on forests
+     * and usually misses only a few edges on sparse graphs
+     */
+    void FindGreedyMatching(vector<pair<int, pair<int, int>>> &result, int max_phases) {
+        FindMatching(result, true, max_phases);
+    }
+
+    /**
+     * @return number of added edges (before FindOptimalMatching) or edges in adjacency (after it)
+     */
+    size_t EdgesCount() const {
+        return added_edges.size() + adjacency.size();
+    }
+
+    const MatchingStats &GetStats() const {
+        return stats;
+    }
+
+private:
+    constexpr static int UNREACHABLE = std::numeric_limits<int>::max();
+
+    struct AddedEdge {
+        int first_vertex;
+        int second_vertex;
+        int vertex_info;
+    };
+
+    /**
+     * Finds initial matching, improves it by at most max_phases phases of Hopcroft-Karp and writes it to result
+     * @param greedy - initial matching by FindKarpSipserMatching, if FindAnyMatching doesn't match
+     * every vertex of first part with edges (then it is maximum already)
+     */
+    void FindMatching(vector<pair<int, pair<int, int>>> &result, bool greedy, long long max_phases) {
+        if (!added_edges.empty() || offsets.empty()) {
+            BuildAdjacency();
+        }
+        matched_edge.assign(first_part_size, -1);
+        matched_vertex.assign(second_part_size, -1);
+        stats = MatchingStats();
+        FindAnyMatching();
+        if (greedy && !IsFirstPartMatched()) {
+            matched_edge.assign(first_part_size, -1);
+            matched_vertex.assign(second_part_size, -1);
+            stats.initial_matched = 0;
+            FindKarpSipserMatching();
+        }
+
+        distance.resize(first_part_size);
+        current_edge.resize(first_part_size);
+        while (stats.phases < max_phases && BuildLayers()) {
+            stats.phases++;
+            for (int vertex = 0; vertex < first_part_size; ++vertex) {
+                current_edge[vertex] = offsets[vertex];
+            }
+            for (int vertex = 0; vertex < first_part_size; ++vertex) {
+                if (matched_edge[vertex] == -1 && TryFindAugmentingPath(vertex)) {
+                    stats.augmentations++;
+                }
             }
         }
-        unordered_map<int, pair<int, int>> result;
-        for (auto pair: matching) {
-            int vertex_info = info.at(pair.second).at(pair.first);
-            result.emplace(pair.first, std::make_pair(pair.second, vertex_info));
+
+        result.clear();
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            if (matched_edge[vertex] != -1) {
+                const auto &edge = adjacency[matched_edge[vertex]];
+                result.emplace_back(edge.second_vertex, std::make_pair(vertex, edge.VertexInfo()));
+            }
         }
+    }
 
-        return result;
+    /**
+     * Moves added edges to compressed sparse rows: edges of vertex v from first part are
+     * adjacency[offsets[v]..offsets[v + 1])
+     */
+    void BuildAdjacency() {
+        offsets.assign(first_part_size + 1, 0);
+        for (const auto &edge: added_edges) {
+            offsets[edge.first_vertex + 1]++;
+        }
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            offsets[vertex + 1] += offsets[vertex];
+        }
+        adjacency.resize(added_edges.size());
+        vector<int> position(offsets.begin(), offsets.end() - 1);
+        for (const auto &edge: added_edges) {
+            adjacency[position[edge.first_vertex]++] = {edge.second_vertex, edge.vertex_info};
+        }
+        added_edges.clear();
+        added_edges.shrink_to_fit();
     }
 
-private:
+    /**
+     * Breadth-first search from all free vertexes of first part over alternating paths
+     * @return true if there is free vertex in second part reachable from them
+     * Fills distance: number of matched edges on shortest alternating path to vertex from first part,
+     * and free_distance: distance of the nearest vertex, which has an edge to free vertex of second part.
+     * Search stops at that layer, as only shortest augmenting paths are found in a phase
+     */
+    bool BuildLayers() {
+        queue.clear();
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            if (matched_edge[vertex] == -1) {
+                distance[vertex] = 0;
+                queue.push_back(vertex);
+            } else {
+                distance[vertex] = UNREACHABLE;
+            }
+        }
+        free_distance = UNREACHABLE;
+        for (size_t head = 0; head < queue.size(); ++head) {
+            int vertex = queue[head];
+            if (distance[vertex] > free_distance) {
+                break;
+            }
+            for (int i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+                int matched = matched_vertex[adjacency[i].second_vertex];
+                if (matched == -1) {
+                    free_distance = distance[vertex];
+                } else if (distance[matched] == UNREACHABLE && distance[vertex] < free_distance) {
+                    distance[matched] = distance[vertex] + 1;
+                    queue.push_back(matched);
+                }
+            }
+        }
+        return free_distance != UNREACHABLE;
+    }
 
     /**
-     * @param first_part_vertex - vertex, for which trying to find augmenting path
-     * @param used unordered_set with edges from first part of bipartite graph,
-     * which are used in matching
-     * @param matching - matching
+     * @param first_part_vertex - free vertex, for which trying to find augmenting path
      * @return true if augmenting path is found, false - else
      * If augmenting path is found, rearranges edges to add path to matching
-     * Finds augmenting path using ComponentDfs
+     * Finds augmenting path by depth-first search along layers, iteratively with explicit stack
      */
-    bool TryFindAugmentingPath(int first_part_vertex, unordered_set<int> &used, unordered_map<int, int> &matching) {
-        if (used.find(first_part_vertex) != used.end()) {
-            return false;
-        }
-        used.emplace(first_part_vertex);
-        for (auto vertex: edges.find(first_part_vertex)->second) {
-            if (matching.find(vertex) == matching.end()
-                || TryFindAugmentingPath(matching.find(vertex)->second, used, matching)) {
-                matching.emplace(vertex, first_part_vertex);
+    bool TryFindAugmentingPath(int first_part_vertex) {
+        stack.clear();
+        stack.push_back(first_part_vertex);
+        stats.visits++;
+        while (!stack.empty()) {
+            int vertex = stack.back();
+            if (current_edge[vertex] == offsets[vertex + 1]) {
+                // dead end, never visit this vertex again in this phase
+                distance[vertex] = UNREACHABLE;
+                stack.pop_back();
+                if (!stack.empty()) {
+                    current_edge[stack.back()]++;
+                }
+                continue;
+            }
+            int matched = matched_vertex[adjacency[current_edge[vertex]].second_vertex];
+            if (matched == -1 && distance[vertex] == free_distance) {
+                for (int path_vertex: stack) {
+                    matched_edge[path_vertex] = current_edge[path_vertex];
+                    matched_vertex[adjacency[current_edge[path_vertex]].second_vertex] = path_vertex;
+                }
                 return true;
             }
+            if (matched != -1 && distance[vertex] < free_distance && distance[matched] == distance[vertex] + 1) {
+                stack.push_back(matched);
+                stats.visits++;
+            } else {
+                current_edge[vertex]++;
+            }
         }
         return false;
     }
 
     /**
      * Simple heuristic algorithm to find any matching in bipartite graph
-     *
-     * @param used: algorithm fills this unordered_set with edges from first part of bipartite graph,
-     * which are used in matching, that method returns
-     *
-     * @return unordered_map, which includes some matching in bipartite graph
-     * key in unordered_map: vertex in second part, value - vertex in first part which is matched with it
-     */
-    unordered_map<int, int> FindAnyMatching(unordered_set<int> &used) {
-        unordered_map<int, int> matching;
-        for (const auto &first_part_vertex: edges) {
-            for (int vertex: first_part_vertex.second) {
-                if (matching.find(vertex) == matching.end()) {
-                    matching.emplace(vertex, first_part_vertex.first);
-                    used.emplace(first_part_vertex.first);
+     * Fills matched_edge and matched_vertex with some matching in bipartite graph
+     */
+    void FindAnyMatching() {
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            for (int i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+                if (matched_vertex[adjacency[i].second_vertex] == -1) {
+                    matched_vertex[adjacency[i].second_vertex] = vertex;
+                    matched_edge[vertex] = i;
+                    stats.initial_matched++;
                     break;
                 }
             }
         }
-        return matching;
     }
 
-    unordered_map<int, unordered_set<int>> edges; // edges from first part to second
-    unordered_map<int, unordered_map<int, int>> info; // info about vertexes from first part
+    /**
+     * Karp-Sipser heuristic: while there is a free vertex (of any part) with exactly one free neighbour,
+     * matches them, otherwise matches the first free vertex of first part, which has free neighbours,
+     * with its first free neighbour. Matched vertexes are removed with their edges, degrees of neighbours
+     * are decreased. Every vertex is matched or removed once and its edges are read O(1) times, so time is O(n + m)
+     * Edges of second part are kept in linked lists, so arrays of second part are only filled, not scanned:
+     * second part is all vertexes of the graph and is usually much larger than the number of edges
+     * Fills matched_edge and matched_vertex
+     */
+    void FindKarpSipserMatching() {
+        // degree: free neighbours of free vertexes, first part then second part, shifted by first_part_size
+        degree.assign(first_part_size + second_part_size, 0);
+        first_reverse_edge.assign(second_part_size, -1);
+        next_reverse_edge.resize(adjacency.size());
+        edge_owner.resize(adjacency.size());
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            degree[vertex] = offsets[vertex + 1] - offsets[vertex];
+            for (int i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+                int second_vertex = adjacency[i].second_vertex;
+                edge_owner[i] = vertex;
+                next_reverse_edge[i] = first_reverse_edge[second_vertex];
+                first_reverse_edge[second_vertex] = i;
+                degree[first_part_size + second_vertex]++;
+            }
+        }
+        queue.clear();
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            if (degree[vertex] == 1) {
+                queue.push_back(vertex);
+            }
+        }
+        for (const auto &edge: adjacency) {
+            // the only edge of a vertex of degree one is met once
+            if (degree[first_part_size + edge.second_vertex] == 1) {
+                queue.push_back(first_part_size + edge.second_vertex);
+            }
+        }
+
+        size_t head = 0;
+        int next_vertex = 0;
+        while (true) {
+            int edge = -1;
+            if (head < queue.size()) {
+                int vertex = queue[head++];
+                if (vertex < first_part_size) {
+                    if (matched_edge[vertex] == -1 && degree[vertex] == 1) {
+                        edge = FindFreeEdge(vertex);
+                    }
+                } else if (matched_vertex[vertex - first_part_size] == -1 && degree[vertex] == 1) {
+                    for (int i = first_reverse_edge[vertex - first_part_size]; i != -1; i = next_reverse_edge[i]) {
+                        if (matched_edge[edge_owner[i]] == -1) {
+                            edge = i;
+                            break;
+                        }
+                    }
+                }
+                if (edge == -1) {
+                    continue;
+                }
+                stats.reductions++;
+            } else {
+                while (next_vertex < first_part_size && (matched_edge[next_vertex] != -1 || degree[next_vertex] == 0)) {
+                    next_vertex++;
+                }
+                if (next_vertex == first_part_size) {
+                    break;
+                }
+                edge = FindFreeEdge(next_vertex);
+            }
+
+            int first_vertex = edge_owner[edge];
+            int second_vertex = adjacency[edge].second_vertex;
+            matched_edge[first_vertex] = edge;
+            matched_vertex[second_vertex] = first_vertex;
+            stats.initial_matched++;
+            for (int i = offsets[first_vertex]; i < offsets[first_vertex + 1]; ++i) {
+                RemoveEdgeEnd(first_part_size + adjacency[i].second_vertex);
+            }
+            for (int i = first_reverse_edge[second_vertex]; i != -1; i = next_reverse_edge[i]) {
+                RemoveEdgeEnd(edge_owner[i]);
+            }
+        }
+    }
+
+    /**
+     * @return true if every vertex of first part, which has edges, is matched
+     */
+    bool IsFirstPartMatched() const {
+        for (int vertex = 0; vertex < first_part_size; ++vertex) {
+            if (matched_edge[vertex] == -1 && offsets[vertex] != offsets[vertex + 1]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @return index of the first edge of vertex from first part to a free vertex, -1 if there is no such edge
+     */
+    int FindFreeEdge(int vertex) const {
+        for (int i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+            if (matched_vertex[adjacency[i].second_vertex] == -1) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Decreases degree of a vertex (numbered as in degree), whose neighbour is matched
+     */
+    void RemoveEdgeEnd(int vertex) {
+        if (--degree[vertex] == 1) {
+            queue.push_back(vertex);
+        }
+    }
+
+    vector<AddedEdge> added_edges; // edges added before building adjacency
+    int first_part_size = 0; // maximum number of vertex in first part plus one
+    int second_part_size = 0; // maximum number of vertex in second part plus one
+
+    vector<int> offsets; // edges from first part to second, compressed sparse rows
+    vector<Edge> adjacency;
+
+    vector<int> matched_edge; // for vertex from first part: index of matched edge in adjacency or -1
+    IndexArray<Index> matched_vertex; // for vertex from second part: matched vertex from first part or -1
+
+    vector<int> distance; // layers of Hopcroft-Karp phase
+    int free_distance = 0; // layer, from which shortest augmenting paths of the phase go to second part
+    vector<int> current_edge; // for vertex from first part: next edge to try in depth-first search
+    vector<int> queue;
+    vector<int> stack;
+
+    vector<int> first_reverse_edge; // for vertex from second part: index of its first edge in adjacency or -1
+    vector<int> next_reverse_edge; // for edge in adjacency: next edge of its vertex from second part or -1
+    vector<Index> edge_owner; // for edge in adjacency: its vertex from first part
+    vector<int> degree; // free neighbours of vertexes of both parts
+    MatchingStats stats;
 };
 
+using BipartiteGraph = BasicBipartiteGraph<int>;
+
 #endif //HELLOWORLD_BIPARTITEGRAPH_H
@@ -0,0 +1,146 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_BITMATRIX_H
+#define HELLOWORLD_BITMATRIX_H
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using std::vector;
+
+/**
+ * Symmetric square matrix of bits, one bit per pair of vertexes
+ *
+ * Every row starts on a 64-bit word boundary, so a row can be scanned word by word
+ * with ctz/popcount. Symmetry is kept by the caller (Graph sets both (i, j) and (j, i)),
+ * which costs a second bit per pair but lets light neighbours of any vertex be read
+ * from a single contiguous row instead of a row and a column of a triangle.
+ *
+ * Words may be owned by the matrix or given to FromWords (e.g. mapped from a file, see MatrixFile).
+ * Rows are grouped in tiles of TileRows rows, about TILE_BYTES each: the unit, in which code reading
+ * the whole matrix goes through it and asks for the next rows ahead by Prefetch.
+ */
+class BitMatrix {
+public:
+    BitMatrix() = default;
+
+    explicit BitMatrix(int n) : n(n), words_per_row(WordsPerRow(n)),
+                                words(static_cast<size_t>(n) * words_per_row, 0) {}
+
+    /**
+     * Creates matrix on n rows of WordsPerRow(n) words, which are not copied and must outlive the matrix
+     */
+    static BitMatrix FromWords(int n, uint64_t *words) {
+        BitMatrix matrix;
+        matrix.n = n;
+        matrix.words_per_row = WordsPerRow(n);
+        matrix.external_words = words;
+        return matrix;
+    }
+
+    bool Get(int row, int column) const {
+        return (Data()[Offset(row) + (column >> 6)] >> (column & 63)) & 1ULL;
+    }
+
+    void Set(int row, int column) {
+        Data()[Offset(row) + (column >> 6)] |= 1ULL << (column & 63);
+    }
+
+    void Reset(int row, int column) {
+        Data()[Offset(row) + (column >> 6)] &= ~(1ULL << (column & 63));
+    }
+
+    /**
+     * Calls callback(column) for every set bit of the row in increasing order of columns
+     */
+    template<typename Callback>
+    void ForEachInRow(int row, Callback &&callback) const {
+        const uint64_t *begin = Row(row);
+        for (size_t i = 0; i < words_per_row; ++i) {
+            uint64_t word = begin[i];
+            while (word != 0) {
+                callback(static_cast<int>(i * 64 + __builtin_ctzll(word)));
+                word &= word - 1;
+            }
+        }
+    }
+
+    int CountInRow(int row) const {
+        const uint64_t *begin = Row(row);
+        int count = 0;
+        for (size_t i = 0; i < words_per_row; ++i) {
+            count += __builtin_popcountll(begin[i]);
+        }
+        return count;
+    }
+
+    const uint64_t *Row(int row) const {
+        return Data() + Offset(row);
+    }
+
+    size_t WordsPerRow() const {
+        return words_per_row;
+    }
+
+    static size_t WordsPerRow(int n) {
+        return (static_cast<size_t>(n) + 63) / 64;
+    }
+
+    bool IsExternal() const {
+        return external_words != nullptr;
+    }
+
+    int TileRows() const {
+        return std::max<size_t>(1, TILE_BYTES / std::max<size_t>(1, words_per_row * sizeof(uint64_t)));
+    }
+
+    /**
+     * Tells the kernel, that rows [first_row, end_row) will be read soon, so it starts reading them
+     * from the file in the background, does nothing for words owned by the matrix
+     */
+    void Prefetch(int first_row, int end_row) const {
+        end_row = std::min(end_row, n);
+        if (!IsExternal() || first_row >= end_row) {
+            return;
+        }
+        static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+        auto begin = reinterpret_cast<uintptr_t>(Row(first_row)) / page_size * page_size;
+        auto end = reinterpret_cast<uintptr_t>(Row(end_row - 1) + words_per_row);
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+    }
+
+    int Size() const {
+        return n;
+    }
+
+private:
+    const static size_t TILE_BYTES = 1 << 23;
+
+    size_t Offset(int row) const {
+        return static_cast<size_t>(row) * words_per_row;
+    }
+
+    uint64_t *Data() {
+        return external_words != nullptr ? external_words : words.data();
+    }
+
+    const uint64_t *Data() const {
+        return external_words != nullptr ? external_words : words.data();
+    }
+
+    int n = 0;
+    size_t words_per_row = 0;
+    vector<uint64_t> words;
+    uint64_t *external_words = nullptr; // words given to FromWords instead of words
+};
+
+
+#endif //HELLOWORLD_BITMATRIX_H
@@ -0,0 +1,91 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_COUNTINGNEW_H
+#define HELLOWORLD_COUNTINGNEW_H
+
+#pragma once
+
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+/**
+ * Replaces global operator new and delete, so that AllocationCounter counts heap allocations of the program
+ * Must be included by one translation unit of a program, e.g. the one with main (as benchmark.cpp does)
+ */
+
+/**
+ * Counts and makes an allocation for every replaced form of operator new
+ * @param alignment - 0 for default alignment
+ */
+static void *CountedAllocate(size_t size, size_t alignment) {
+    AllocationCounter::Count(size);
+    size = size == 0 ? 1 : size;
+    void *pointer = nullptr;
+    if (alignment == 0) {
+        pointer = std::malloc(size);
+    } else {
+        // aligned_alloc needs a size, which is a multiple of the alignment
+        pointer = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new(size_t size) {
+    return CountedAllocate(size, 0);
+}
+
+void *operator new[](size_t size) {
+    return CountedAllocate(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+// heap counters of SolveStats are written only by programs, which include this header
+static const bool counting_new_installed = AllocationCounter::Install();
+
+
+#endif //HELLOWORLD_COUNTINGNEW_H
@@ -13,6 +13,7 @@
 #include <unordered_set>
 #include <cassert>
 #include "Graph.h"
+#include "IndexArray.h"
 
 using std::vector;
 using std::pair;
@@ -21,27 +22,100 @@ using std::unordered_set;
 using std::cout;
 using std::endl;
 
-const static int HEAVY_EDGE = 2;
+/**
+ * Edges of all cycles, shared by all Cycle objects
+ * Every vertex is in exactly one cycle, so edges are stored in arrays indexed by vertex,
+ * and joining of two cycles only rewires a few links
+ * Index - type of stored vertexes (see IndexArray.h), it must fit n
+ */
+template<typename Index>
+struct BasicCycleLinks {
+    BasicCycleLinks() = default;
+
+    explicit BasicCycleLinks(int n) {
+        Reset(n);
+    }
+
+    /**
+     * Removes all edges of n vertexes, memory of previous edges is reused
+     */
+    void Reset(int n) {
+        next.assign(n, -1);
+        prev.assign(n, -1);
+        heavy.assign(n, false);
+        heavy_next.assign(n, -1);
+        heavy_prev.assign(n, -1);
+    }
+
+    IndexArray<Index> next; // second vertex of the edge, which starts in vertex
+    IndexArray<Index> prev; // first vertex of the edge, which ends in vertex
+    vector<char> heavy; // edge, which starts in vertex, is heavy
+    // circular doubly linked lists of first vertexes of heavy edges, one list per cycle
+    IndexArray<Index> heavy_next;
+    IndexArray<Index> heavy_prev;
+};
+
+using CycleLinks = BasicCycleLinks<int>;
+
+/**
+ * Cycles in two flat arrays: cycle i is vertexes[offsets[i]..offsets[i + 1])
+ * Arrays are not owned, they may be mapped from a file (see InstanceFile)
+ */
+struct FlatCycles {
+    int num_cycles = 0;
+    const int *offsets = nullptr;
+    const int *vertexes = nullptr;
+
+    int Size(int cycle) const {
+        return offsets[cycle + 1] - offsets[cycle];
+    }
+
+    const int *Begin(int cycle) const {
+        return vertexes + offsets[cycle];
+    }
+};
+
+/**
+ * Cycle, whose edges are stored in links shared with other cycles of the same type
+ * Index - type of vertexes in links (see BasicCycleLinks)
+ */
+template<typename Index>
+class BasicCycle {
+    using CycleLinks = BasicCycleLinks<Index>;
 
-class Cycle {
 public:
-    explicit Cycle(vector<int> vertexes, const Graph &graph) : connected_edge(std::pair<int, int>(-1, -1)){
-        for (int i = 1; i < vertexes.size(); ++i) {
-            edges.emplace(vertexes[i - 1], vertexes[i]);
-            inverse_edges.emplace(vertexes[i], vertexes[i - 1]);
-            if (graph.GetEdgeWeight(vertexes[i - 1], vertexes[i]) == HEAVY_EDGE) {
-                heavy_edges.emplace(vertexes[i - 1]);
+    BasicCycle(const vector<int> &vertexes, const Graph &graph, CycleLinks &links)
+            : BasicCycle(vertexes.data(), vertexes.size(), graph, links) {}
+
+    /**
+     * @param vertexes - size vertexes of the cycle in order
+     */
+    BasicCycle(const int *vertexes, int size, const Graph &graph, CycleLinks &links)
+            : BasicCycle(vertexes, size, [&graph](int first, int second) {
+        return graph.GetEdgeWeight(first, second);
+    }, links) {}
+
+    /**
+     * @param weight - weight(first, second) is weight of the edge of the cycle
+     */
+    template<typename Weight>
+    BasicCycle(const int *vertexes, int size, Weight &&weight, CycleLinks &links)
+            : links(&links), first_vertex(vertexes[0]), size(size),
+              connected_edge(std::pair<int, int>(-1, -1)) {
+        for (int i = 0; i < size; ++i) {
+            int first = vertexes[i];
+            int second = vertexes[i + 1 == size ? 0 : i + 1];
+            links.next[first] = second;
+            links.prev[second] = first;
+            links.heavy[first] = false;
+            if (weight(first, second) == HEAVY_EDGE) {
+                AddHeavyEdge(first);
             }
         }
-        if (graph.GetEdgeWeight(vertexes[vertexes.size() - 1], vertexes[0]) == HEAVY_EDGE) {
-            heavy_edges.emplace(vertexes[vertexes.size() - 1]);
-        }
-        edges.emplace(vertexes[vertexes.size() - 1], vertexes[0]);
-        inverse_edges.emplace(vertexes[0], vertexes[vertexes.size() - 1]);
     }
 
-    bool IsGood() {
-        return heavy_edges.empty();
+    bool IsGood() const {
+        return heavy_edges == -1;
     }
 
     pair<int, int> GetConnectedEdge() const {
@@ -58,9 +132,9 @@ public:
      * @param second_vertex
      */
     void DeleteEdge(int first_vertex, int second_vertex) {
-        edges.erase(first_vertex);
-        inverse_edges.erase(second_vertex);
-        heavy_edges.erase(first_vertex);
+        links->next[first_vertex] = -1;
+        links->prev[second_vertex] = -1;
+        DeleteHeavyEdge(first_vertex);
     }
 
     /**
@@ -70,93 +144,155 @@ public:
      * @param weight_of_new_edge - weight of added edge
      */
     void ChangeEdge(int first, int new_second, int weight_of_new_edge) {
-        inverse_edges.erase(edges.find(first)->second);
-        edges.find(first)->second = new_second;
-        inverse_edges.emplace(new_second, first);
-        heavy_edges.erase(first);
+        links->next[first] = new_second;
+        links->prev[new_second] = first;
+        DeleteHeavyEdge(first);
         if (weight_of_new_edge == HEAVY_EDGE) {
-            heavy_edges.emplace(first);
+            AddHeavyEdge(first);
         }
     }
 
     /**
      * Add edges of another cycle to this cycle
+     * Edges are already in links, so only lists of heavy edges are concatenated
      * @param cycle - another cycle
      */
-    void AddCycle(const Cycle &cycle) {
-        for (auto edge: cycle.edges) {
-            edges.emplace(edge.first, edge.second);
-            inverse_edges.emplace(edge.second, edge.first);
+    void AddCycle(const BasicCycle &cycle) {
+        size += cycle.size;
+        if (cycle.heavy_edges == -1) {
+            return;
         }
-        for (auto heavy_edge: cycle.heavy_edges) {
-            heavy_edges.emplace(heavy_edge);
+        if (heavy_edges == -1) {
+            heavy_edges = cycle.heavy_edges;
+            return;
         }
+        int tail = links->heavy_prev[heavy_edges];
+        int other_tail = links->heavy_prev[cycle.heavy_edges];
+        links->heavy_next[tail] = cycle.heavy_edges;
+        links->heavy_prev[cycle.heavy_edges] = tail;
+        links->heavy_next[other_tail] = heavy_edges;
+        links->heavy_prev[heavy_edges] = other_tail;
     }
 
     /**
      * @return edge of maximum weight in the graph
      */
-    pair<int, int> GetEdgeOfMaximumWeight() {
-        if (heavy_edges.empty()) {
-            return std::make_pair(edges.begin()->first, edges.begin()->second);
-        } else {
-            int first = *heavy_edges.begin();
-            int second = GetSecond(first);
-            return std::make_pair(first, second);
-        }
+    pair<int, int> GetEdgeOfMaximumWeight() const {
+        int first = heavy_edges == -1 ? first_vertex : heavy_edges;
+        return std::make_pair(first, GetSecond(first));
     }
 
     /**
      * @param first - first vertex of the edge
      * @return second vertex of the edge
      */
-    int GetSecond(int first) {
-        return edges.at(first);
+    int GetSecond(int first) const {
+        return links->next[first];
+    }
+
+    int GetPrev(int first) const {
+        return links->prev[first];
     }
 
-    int GetPrev(int first) {
-        return inverse_edges.at(first);
+    /**
+     * Calls callback(first) for first vertex of every heavy edge
+     */
+    template<typename Callback>
+    void ForEachHeavyEdge(Callback &&callback) const {
+        if (heavy_edges == -1) {
+            return;
+        }
+        int vertex = heavy_edges;
+        do {
+            callback(vertex);
+            vertex = links->heavy_next[vertex];
+        } while (vertex != heavy_edges);
     }
 
-    const unordered_set<int> &GetHeavyEdges() const {
-        return heavy_edges;
+    /**
+     * Calls callback(vertex) for every vertex of the cycle in order of the cycle
+     */
+    template<typename Callback>
+    void ForEachVertex(Callback &&callback) const {
+        int vertex = first_vertex;
+        do {
+            callback(vertex);
+            vertex = links->next[vertex];
+        } while (vertex != first_vertex);
     }
 
-    unordered_map<int, int>& GetEdges() {
-        return edges;
+    int Size() const {
+        return size;
     }
 
-    void Print() {
-        auto first = edges.begin()->first;
-        cout << first << " ";
-        auto next = edges.find(first)->second;
-        while (next != first) {
-            cout << next << " ";
-            next = edges.find(next)->second;
-        }
+    void Print() const {
+        ForEachVertex([](int vertex) {
+            cout << vertex << " ";
+        });
     }
 
-    vector<int> GetCycle() {
+    vector<int> GetCycle() const {
         vector<int> cycle;
-        auto first = edges.begin()->first;
-        cycle.push_back(first);
-        auto next = edges.find(first)->second;
-        while (next != first) {
-            cycle.push_back(next);
-            assert(cycle.size() <= this->edges.size());
-            next = edges.find(next)->second;
-        }
+        GetCycle(cycle);
         return cycle;
     }
 
+    /**
+     * Writes vertexes of the cycle in order to cycle, reusing its memory
+     */
+    void GetCycle(vector<int> &cycle) const {
+        cycle.clear();
+        cycle.reserve(size);
+        ForEachVertex([&](int vertex) {
+            cycle.push_back(vertex);
+            assert(static_cast<int>(cycle.size()) <= size);
+        });
+    }
+
 private:
-    unordered_map<int, int> edges; // key - first vertex, value - second
-    unordered_map<int, int> inverse_edges; // key - first vertex, value - second
+    void AddHeavyEdge(int first) {
+        links->heavy[first] = true;
+        if (heavy_edges == -1) {
+            heavy_edges = first;
+            links->heavy_next[first] = first;
+            links->heavy_prev[first] = first;
+            return;
+        }
+        int tail = links->heavy_prev[heavy_edges];
+        links->heavy_next[tail] = first;
+        links->heavy_prev[first] = tail;
+        links->heavy_next[first] = heavy_edges;
+        links->heavy_prev[heavy_edges] = first;
+    }
+
+    void DeleteHeavyEdge(int first) {
+        if (!links->heavy[first]) {
+            return;
+        }
+        links->heavy[first] = false;
+        if (links->heavy_next[first] == first) {
+            heavy_edges = -1;
+            return;
+        }
+        int next = links->heavy_next[first];
+        int prev = links->heavy_prev[first];
+        links->heavy_next[prev] = next;
+        links->heavy_prev[next] = prev;
+        if (heavy_edges == first) {
+            heavy_edges = next;
+        }
+    }
+
+    CycleLinks *links;
+    int first_vertex; // any vertex of the cycle, bypass of the cycle starts from it
+    int size; // number of vertexes
     pair<int, int> connected_edge; // store edge, which goes from this cycle in bipartite graph,
     // first vertex - in cycle, second vertex - not in cycle
-    unordered_set<int> heavy_edges;
-    // store of first vertexes of heavy edges
+    int heavy_edges = -1;
+    // first vertex of any heavy edge in the list of heavy edges of this cycle, or -1
 };
 
+using Cycle = BasicCycle<int>;
+
 
 #endif //HELLOWORLD_CYCLE_H
@@ -0,0 +1,304 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_CYCLECOVER_H
+#define HELLOWORLD_CYCLECOVER_H
+
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cassert>
+#include "BipartiteGraph.h"
+#include "Graph.h"
+#include "UnionFind.h"
+
+using std::vector;
+using std::pair;
+using std::unordered_map;
+using std::unordered_set;
+
+const static int MIN_CYCLE_LENGTH = 4;
+
+/**
+ * Builds cover of all vertexes of a graph by cycles of length at least 4 with as many light edges as possible
+ *
+ * Each vertex chooses light successor by maximum matching in a bipartite graph,
+ * where both parts are copies of vertexes and edges are light edges of a graph.
+ * Matching splits vertexes on paths and cycles of light edges. Cycles shorter than 4 are joined to longer cycles
+ * or paths through two light edges where it is possible, the rest are cut into paths. Ends of paths are linked
+ * by light edges greedily, and the chains are joined into one more cycle.
+ *
+ * Experimental: it is a heuristic, the cover is not a minimum triangle-free 2-matching, which the 7/6 guarantee
+ * of Papadimitriou-Yannakakis relies on, so with this cover the tour may be worse than 7/6 of the optimum
+ * (e.g. 4/3 on some graphs of 9 vertexes with a light Hamiltonian cycle, helloworld 9 0 9 5).
+ * Pass a minimum triangle-free cover to TSPApproximation, where one is known.
+ */
+class CycleCover {
+public:
+    explicit CycleCover(const Graph &graph) : graph(graph), next(graph.Size(), -1), prev(graph.Size(), -1) {}
+
+    vector<vector<int>> FindCycles() {
+        int n = graph.Size();
+        if (n < MIN_CYCLE_LENGTH) {
+            vector<int> cycle(n);
+            for (int i = 0; i < n; ++i) {
+                cycle[i] = i;
+            }
+            return {cycle};
+        }
+
+        FindSuccessors();
+        JoinShortCycles();
+
+        vector<vector<int>> cycles;
+        vector<int> path_starts;
+        CutShortCycles(cycles, path_starts);
+        if (!path_starts.empty()) {
+            auto chain = ChainPaths(path_starts);
+            if (chain.size() < MIN_CYCLE_LENGTH) {
+                // chain is too short to be a cycle by itself, insert it into any other cycle
+                assert(!cycles.empty());
+                auto &cycle = cycles.back();
+                cycle.insert(cycle.end(), chain.begin(), chain.end());
+            } else {
+                cycles.push_back(std::move(chain));
+            }
+        }
+        return cycles;
+    }
+
+private:
+    /**
+     * Fills next and prev with light edges chosen by maximum matching
+     */
+    void FindSuccessors() {
+        BipartiteGraph bipartite_graph;
+        for (int vertex = 0; vertex < graph.Size(); ++vertex) {
+            graph.ForEachLightNeighbour(vertex, [&](int another_vertex) {
+                bipartite_graph.AddEdge(vertex, another_vertex);
+            });
+        }
+        auto matching = bipartite_graph.FindOptimalMatching();
+        for (auto edge: matching) {
+            // edge.first - successor, edge.second.first - vertex
+            next[edge.second.first] = edge.first;
+            prev[edge.first] = edge.second.first;
+        }
+    }
+
+    /**
+     * Removes cycles shorter than 4 without losing light edges, where it is possible:
+     * edge (a, c) of a short cycle and edge (x, d) of a long cycle or a path are replaced by (a, x) and (c, d),
+     * if both are light, so the short cycle becomes a part of the other one.
+     * A cycle of two vertexes uses its light edge twice, so joining it even adds a light edge
+     */
+    void JoinShortCycles() {
+        int n = graph.Size();
+        vector<int> component(n, -1);
+        vector<char> is_short;
+        vector<int> short_cycles; // a vertex of every short cycle
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (prev[vertex] == -1) {
+                for (int v = vertex; v != -1; v = next[v]) {
+                    component[v] = is_short.size();
+                }
+                is_short.push_back(false);
+            }
+        }
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (component[vertex] != -1) {
+                continue;
+            }
+            int size = 0;
+            for (int v = vertex; component[v] == -1; v = next[v]) {
+                component[v] = is_short.size();
+                ++size;
+            }
+            is_short.push_back(size < MIN_CYCLE_LENGTH);
+            if (size < MIN_CYCLE_LENGTH) {
+                short_cycles.push_back(vertex);
+            }
+        }
+
+        for (int start: short_cycles) {
+            bool joined = false;
+            int a = start;
+            do {
+                graph.ForEachLightNeighbour(a, [&](int x) {
+                    // two short cycles would make one more cycle of 4-6 vertexes, while cut into paths
+                    // they are linked into chains with other paths
+                    if (joined || component[x] == component[a] || is_short[component[x]]) {
+                        return;
+                    }
+                    for (int c: {next[a], prev[a]}) {
+                        for (int d: {prev[x], next[x]}) {
+                            if (!joined && d != -1 && graph.GetEdgeWeight(c, d) == LIGHT_EDGE) {
+                                SpliceCycle(a, c, x, d, component);
+                                joined = true;
+                            }
+                        }
+                    }
+                });
+                a = next[a];
+            } while (!joined && a != start);
+        }
+    }
+
+    /**
+     * Replaces edge (a, c) of a short cycle and edge (x, d) of another component with (a, x) and (c, d)
+     * The short cycle is reversed, if its direction doesn't match, and gets the component of x
+     */
+    void SpliceCycle(int a, int c, int x, int d, vector<int> &component) {
+        vector<int> cycle;
+        for (int v = a; cycle.empty() || v != a; v = next[v]) {
+            cycle.push_back(v);
+        }
+        if ((d == prev[x]) != (c == next[a])) {
+            for (int v: cycle) {
+                std::swap(next[v], prev[v]);
+            }
+        }
+        if (d == prev[x]) {
+            // ... d x ... and a c ... -> ... d c ... a x ...
+            next[a] = x;
+            prev[x] = a;
+            next[d] = c;
+            prev[c] = d;
+        } else {
+            // ... x d ... and c a ... -> ... x a ... c d ...
+            next[x] = a;
+            prev[a] = x;
+            next[c] = d;
+            prev[d] = c;
+        }
+        for (int v: cycle) {
+            component[v] = component[x];
+        }
+    }
+
+    /**
+     * Collects cycles of light edges with length at least 4 to cycles
+     * and cuts shorter cycles, so that all other vertexes are covered by paths
+     * @param path_starts - filled with first vertexes of all paths
+     */
+    void CutShortCycles(vector<vector<int>> &cycles, vector<int> &path_starts) {
+        int n = graph.Size();
+        vector<char> visited(n, false);
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (prev[vertex] == -1) {
+                for (int v = vertex; v != -1; v = next[v]) {
+                    visited[v] = true;
+                }
+            }
+        }
+        // all not visited vertexes are in cycles
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (visited[vertex]) {
+                continue;
+            }
+            vector<int> cycle;
+            for (int v = vertex; !visited[v]; v = next[v]) {
+                visited[v] = true;
+                cycle.push_back(v);
+            }
+            if (cycle.size() >= MIN_CYCLE_LENGTH) {
+                cycles.push_back(std::move(cycle));
+            } else {
+                next[cycle.back()] = -1;
+                prev[cycle.front()] = -1;
+            }
+        }
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (prev[vertex] == -1) {
+                path_starts.push_back(vertex);
+            }
+        }
+    }
+
+    /**
+     * Joins all paths in one sequence of vertexes.
+     * First links ends of different paths by light edges greedily, every end is linked at most once
+     * and links never close a cycle, so paths are joined into longer chains. Chains are concatenated,
+     * and only the connections between chains are heavy
+     */
+    vector<int> ChainPaths(const vector<int> &path_starts) {
+        int n = graph.Size();
+        // for the vertexes of paths: index of a path in path_starts
+        vector<int> path_of(n, -1);
+        vector<int> path_ends(path_starts.size());
+        for (int i = 0; i < static_cast<int>(path_starts.size()); ++i) {
+            for (int v = path_starts[i]; v != -1; v = next[v]) {
+                path_of[v] = i;
+                path_ends[i] = v;
+            }
+        }
+
+        // link[v] - up to two vertexes linked with v, a single vertex path may be linked from both sides
+        vector<pair<int, int>> link(n, {-1, -1});
+        UnionFind chains(path_starts.size());
+        auto free_ends = [&](int vertex) {
+            return (prev[vertex] == -1 && link[vertex].first == -1) + (next[vertex] == -1 && link[vertex].second == -1);
+        };
+        auto add_link = [&](int vertex, int another_vertex) {
+            (prev[vertex] == -1 && link[vertex].first == -1 ? link[vertex].first : link[vertex].second) = another_vertex;
+        };
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (path_of[vertex] == -1 || (prev[vertex] != -1 && next[vertex] != -1)) {
+                continue;
+            }
+            graph.ForEachLightNeighbour(vertex, [&](int another_vertex) {
+                if (path_of[another_vertex] == -1 || free_ends(vertex) == 0 || free_ends(another_vertex) == 0 ||
+                    chains.Find(path_of[vertex]) == chains.Find(path_of[another_vertex])) {
+                    return;
+                }
+                chains.Union(path_of[vertex], path_of[another_vertex]);
+                add_link(vertex, another_vertex);
+                add_link(another_vertex, vertex);
+            });
+        }
+
+        // every vertex has at most two neighbours by edges of paths and links, and they form no cycles,
+        // so chains are walked from their ends
+        auto neighbours = [&](int vertex) {
+            return std::array<int, 4>{prev[vertex], next[vertex], link[vertex].first, link[vertex].second};
+        };
+        vector<char> used(n, false);
+        vector<int> chain;
+        chain.reserve(n);
+        for (int i = 0; i < static_cast<int>(path_starts.size()); ++i) {
+            for (int end: {path_starts[i], path_ends[i]}) {
+                auto end_neighbours = neighbours(end);
+                if (used[end] || std::count(end_neighbours.begin(), end_neighbours.end(), -1) < 3) {
+                    // walked already or not an end of a chain
+                    continue;
+                }
+                int previous = -1;
+                for (int v = end; v != -1;) {
+                    used[v] = true;
+                    chain.push_back(v);
+                    int following = -1;
+                    for (int neighbour: neighbours(v)) {
+                        if (neighbour != -1 && neighbour != previous) {
+                            following = neighbour;
+                        }
+                    }
+                    previous = v;
+                    v = following;
+                }
+            }
+        }
+        return chain;
+    }
+
+    const Graph &graph;
+    vector<int> next; // successor of vertex by light edge or -1
+    vector<int> prev; // predecessor of vertex by light edge or -1
+};
+
+
+#endif //HELLOWORLD_CYCLECOVER_H
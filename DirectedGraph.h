@@ -12,6 +12,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cassert>
+#include <algorithm>
+#include "IndexArray.h"
 
 using std::vector;
 using std::pair;
@@ -20,35 +22,109 @@ using std::unordered_set;
 using std::cout;
 using std::endl;
 
-enum Colors {
-    GREY, BLACK
-};
-
-class DirectedGraph {
+/**
+ * Directed graph in which every vertex has no more than one incoming edge
+ * (graph of cycles, where edge goes from the cycle to the cycle matched with one of its vertexes)
+ *
+ * Every component of such graph is an out-tree or a single cycle with out-trees hanging from its vertexes,
+ * so it is stored as array of parents (one incoming edge) and lists of children,
+ * and all searches are linear walks over arrays without recursion
+ * Searches return references to buffers of the graph, which are valid until the next search of the same kind,
+ * and Clear keeps all memory, so a graph reused for graphs of similar size doesn't allocate
+ * Index - type of vertexes in parents and lists of children (see IndexArray.h), it must fit the number of vertexes
+ */
+template<typename Index>
+class BasicDirectedGraph {
 public:
-    DirectedGraph() = default;
+    /**
+     * Range of children of a vertex
+     */
+    class Children {
+    public:
+        Children(const Index *first, const Index *last) : first(first), last(last) {}
 
-    void AddEdge(int first_vertex, int second_vertex) {
-        if (edges.find(first_vertex) == edges.end()) {
-            edges.emplace(first_vertex, unordered_set<int>());
+        const Index *begin() const {
+            return first;
+        }
+
+        const Index *end() const {
+            return last;
         }
-        if (edges.find(second_vertex) == edges.end()) {
-            edges.emplace(second_vertex, unordered_set<int>());
+
+        size_t size() const {
+            return last - first;
+        }
+
+        bool empty() const {
+            return first == last;
         }
-        edges.find(first_vertex)->second.emplace(second_vertex);
+
+    private:
+        const Index *first;
+        const Index *last;
+    };
+
+    BasicDirectedGraph() = default;
+
+    /**
+     * Removes all edges
+     */
+    void Clear() {
+        parent.clear();
+        present.clear();
+    }
+
+    /**
+     * Adds edge, second_vertex must not have incoming edges yet
+     */
+    void AddEdge(int first_vertex, int second_vertex) {
+        size_t size = std::max(first_vertex, second_vertex) + 1;
+        if (size > parent.size()) {
+            parent.resize(size, NO_VERTEX);
+            present.resize(size, false);
+        }
+        assert(parent[second_vertex] == NO_VERTEX);
+        parent[second_vertex] = first_vertex;
+        present[first_vertex] = true;
+        present[second_vertex] = true;
     }
 
     /**
-     * @return set of a start vertexes, starting from which you can go to any vertex in component
-     * (if component has a cycle, it will be vertex from cycle)
+     * @return start vertexes, starting from which you can go to any vertex in component
+     * (if component has a cycle, it will be vertex from cycle, else - root of a tree)
+     *
+     * Each vertex is walked up by parents once, so it takes linear time
      */
-    unordered_set<int> FindComponents() {
-        unordered_set<int> start_vertexes;
-        unordered_map<int, int> colors;
-        for (const auto &v: edges) {
-            if (colors.find(v.first) == colors.end()) {
-                start_vertexes.emplace(v.first);
-                ComponentDfs(v, colors, start_vertexes);
+    const vector<int> &FindComponents() {
+        BuildChildren();
+        int n = parent.size();
+        // vertex, from which component of the vertex can be bypassed
+        start_of.assign(n, NO_VERTEX);
+        start_vertexes.clear();
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (!present[vertex] || start_of[vertex] != NO_VERTEX) {
+                continue;
+            }
+            // go up until the root, already bypassed vertex or vertex, which is already in path
+            path.clear();
+            int v = vertex;
+            while (v != NO_VERTEX && start_of[v] == NO_VERTEX) {
+                start_of[v] = IN_PATH;
+                path.push_back(v);
+                v = parent[v];
+            }
+            int start;
+            if (v == NO_VERTEX) {
+                start = path.back();
+                start_vertexes.push_back(start);
+            } else if (start_of[v] == IN_PATH) {
+                start = v;
+                start_vertexes.push_back(start);
+            } else {
+                start = start_of[v];
+            }
+            for (auto u: path) {
+                start_of[u] = start;
             }
         }
         return start_vertexes;
@@ -56,60 +132,115 @@ public:
 
     /**
      * Finds cycle in a component which can be bypassed from start_vertex
-     * @param start_vertex - vertex, from which we can call CycleDfs and go over all vertex in component
+     * @param start_vertex - vertex, returned by FindComponents
      * @return cycle, if it exists (there can be no more than one cycle), or start_vertex, if there no cycle
+     * every next vertex of a cycle is a child of previous one
      */
-    vector<int> FindCycle(int start_vertex) {
-        unordered_map<int, int> colors;
-        unordered_map<int, int> p;
-        vector<int> cycle;
-        CycleDfs(*edges.find(start_vertex), colors, p, cycle);
-        if (cycle.empty()) {
-            cycle.push_back(start_vertex);
-        }
+    const vector<int> &FindCycle(int start_vertex) {
+        FindCycle(start_vertex, cycle);
         return cycle;
     }
 
-    unordered_map<int, unordered_set<int>>& GetEdges() {
-        return edges;
+    /**
+     * Same as above, but writes cycle to a buffer of the caller, so different components
+     * can be searched by different threads at once
+     */
+    void FindCycle(int start_vertex, vector<int> &cycle) {
+        cycle.clear();
+        cycle.push_back(start_vertex);
+        if (parent[start_vertex] == NO_VERTEX) {
+            return;
+        }
+        // start vertex is in cycle, so going up by parents we return to it
+        for (int v = parent[start_vertex]; v != start_vertex; v = parent[v]) {
+            cycle.push_back(v);
+        }
+        std::reverse(cycle.begin() + 1, cycle.end());
+        for (auto v: cycle) {
+            on_cycle[v] = true;
+        }
+    }
+
+    bool IsOnCycle(int vertex) const {
+        return on_cycle[vertex];
     }
 
-private:
-    void ComponentDfs(const pair<int, unordered_set<int>> &v,
-                      unordered_map<int, int> &colors,
-                      unordered_set<int> &start_vertexes) {
-        colors.emplace(v.first, GREY);
-        for (auto u: v.second) {
-            if (colors.find(u) == colors.end()) {
-                ComponentDfs(*edges.find(u), colors, start_vertexes);
-            } else if (colors.find(u)->second != GREY) {
-                start_vertexes.erase(u);
+    Children GetChildren(int vertex) const {
+        return {children.data() + offsets[vertex], children.data() + offsets[vertex + 1]};
+    }
+
+    /**
+     * @return vertexes of the tree with root in vertex in order of increasing depth,
+     * vertexes of the cycle of the component are not included (except root)
+     */
+    const vector<int> &FindTreeOrder(int root) {
+        FindTreeOrder(root, order);
+        return order;
+    }
+
+    /**
+     * Same as above, but writes order to a buffer of the caller, as FindCycle
+     */
+    void FindTreeOrder(int root, vector<int> &order) const {
+        order.clear();
+        order.push_back(root);
+        for (size_t head = 0; head < order.size(); ++head) {
+            for (auto u: GetChildren(order[head])) {
+                if (!on_cycle[u]) {
+                    order.push_back(u);
+                }
             }
         }
-        colors.find(v.first)->second = BLACK;
     }
 
-    void CycleDfs(const pair<int, unordered_set<int>> &v, unordered_map<int, int> &colors,
-                  unordered_map<int, int>& p, vector<int>& cycle) {
-        colors.emplace(v.first, GREY);
-        for (auto u: v.second) {
-            if (colors.find(u) == colors.end()) {
-                p.emplace(u, v.first);
-                CycleDfs(*edges.find(u), colors, p, cycle);
-            } else if (colors.find(u)->second == GREY) {
-                cycle.push_back(u);
-                int next = v.first;
-                while (next != u) {
-                    cycle.push_back(next);
-                    next = p.find(next)->second;
-                }
+    int Size() const {
+        return parent.size();
+    }
+
+private:
+    constexpr static int NO_VERTEX = -1;
+    constexpr static int IN_PATH = -2;
+
+    /**
+     * Builds lists of children from parents (compressed sparse rows)
+     */
+    void BuildChildren() {
+        int n = parent.size();
+        offsets.assign(n + 1, 0);
+        for (int v = 0; v < n; ++v) {
+            if (parent[v] != NO_VERTEX) {
+                offsets[parent[v] + 1]++;
+            }
+        }
+        for (int v = 0; v < n; ++v) {
+            offsets[v + 1] += offsets[v];
+        }
+        children.resize(offsets[n]);
+        position.assign(offsets.begin(), offsets.end() - 1);
+        for (int v = 0; v < n; ++v) {
+            if (parent[v] != NO_VERTEX) {
+                children[position[parent[v]]++] = v;
             }
         }
-        colors.find(v.first)->second = BLACK;
+        on_cycle.assign(n, false);
     }
 
-    unordered_map<int, unordered_set<int>> edges;
+    IndexArray<Index> parent; // the only vertex with edge to this vertex or NO_VERTEX
+    vector<char> present; // vertex has at least one edge
+    vector<Index> offsets; // children of vertex v are children[offsets[v]..offsets[v + 1])
+    vector<Index> children;
+    vector<char> on_cycle; // vertex is in cycle, found by FindCycle
+
+    // buffers of searches
+    vector<int> position;
+    vector<int> start_of;
+    vector<int> path;
+    vector<int> start_vertexes;
+    vector<int> cycle;
+    vector<int> order;
 };
 
+using DirectedGraph = BasicDirectedGraph<int>;
+
 
 #endif //HELLOWORLD_DIRECTEDGRAPH_H
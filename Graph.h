@@ -12,6 +12,11 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cassert>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include "BitMatrix.h"
+#include "IndexArray.h"
 
 using std::vector;
 using std::pair;
@@ -20,32 +25,401 @@ using std::unordered_set;
 using std::cout;
 using std::endl;
 
+const static int LIGHT_EDGE = 1;
+const static int HEAVY_EDGE = 2;
+
+/**
+ * Complete graph with edges of weight 1 and 2
+ * Stores only light edges, every other pair of vertexes has weight 2
+ *
+ * Two storages are supported:
+ * dense - one bit per pair of vertexes, filled by AddEdge, or a matrix given to FromBitMatrix
+ * (e.g. mapped from a file, see MatrixFile, such graph IsMapped)
+ * sparse - sorted lists of light neighbours (CSR), built once by FromLightEdges,
+ * takes O(n + m) memory, where m - number of light edges,
+ * or arrays owned by somebody else (e.g. mapped from a file, see InstanceFile), given to FromCSR
+ * AddEdge on sparse storage copies the lists of both vertexes to patched_rows and changes the copies,
+ * so that CSR arrays are not rebuilt for every edge and may stay read-only, until ApplyPatches moves the copies
+ * into the arrays
+ * FromLightEdges stores lists in the narrowest index type, which fits n (NarrowIndex or int):
+ * loops over lists are compiled for each type, and the type is chosen once per call, as dense or sparse.
+ * The threshold is NARROW_INDEX_VERTEXES, the same as for structures of the construction (see IndexArray.h)
+ */
 class Graph {
 public:
-    explicit Graph(int n) {
+    explicit Graph(int n) : n(n), dense(true), light_edges(n) {}
+
+    /**
+     * Creates graph in dense storage
+     * @param edges - matrix of weights
+     */
+    static Graph FromMatrix(const vector<vector<int>> &edges) {
+        Graph graph(edges.size());
+        int n = edges.size();
+        for (int i = 0; i < n; ++i) {
+            for (int j = i + 1; j < n; ++j) {
+                if (edges[i][j] == LIGHT_EDGE) {
+                    graph.AddEdge(i, j, LIGHT_EDGE);
+                }
+            }
+        }
+        return graph;
+    }
+
+    /**
+     * Creates graph in sparse storage
+     * @param n - number of vertexes
+     * @param light_edges - edges of weight 1, each pair is listed once in any direction
+     */
+    static Graph FromLightEdges(int n, const vector<pair<int, int>> &light_edges) {
+        Graph graph;
+        graph.n = n;
+        graph.dense = false;
+        graph.offsets.assign(n + 1, 0);
+        for (const auto &edge: light_edges) {
+            graph.offsets[edge.first + 1]++;
+            graph.offsets[edge.second + 1]++;
+        }
+        for (int i = 0; i < n; ++i) {
+            graph.offsets[i + 1] += graph.offsets[i];
+        }
+        graph.neighbours.resize(graph.offsets[n]);
+        vector<int> position(graph.offsets.begin(), graph.offsets.end() - 1);
+        for (const auto &edge: light_edges) {
+            graph.neighbours[position[edge.first]++] = edge.second;
+            graph.neighbours[position[edge.second]++] = edge.first;
+        }
+
+        // sort every list and remove repeated edges, compacting lists to the left
+        int size = 0;
         for (int i = 0; i < n; ++i) {
-            edges.emplace(i, unordered_map<int, int>());
+            auto begin = graph.neighbours.begin() + graph.offsets[i];
+            auto end = graph.neighbours.begin() + graph.offsets[i + 1];
+            std::sort(begin, end);
+            end = std::unique(begin, end);
+            graph.offsets[i] = size;
+            size = static_cast<int>(std::copy(begin, end, graph.neighbours.begin() + size) - graph.neighbours.begin());
+        }
+        graph.offsets[n] = size;
+        graph.neighbours.resize(size);
+        graph.narrow = n <= NARROW_INDEX_VERTEXES;
+        if (graph.narrow) {
+            graph.narrow_neighbours.assign(graph.neighbours.begin(), graph.neighbours.end());
+            graph.neighbours = vector<int>();
+        } else {
+            graph.neighbours.shrink_to_fit();
         }
+        return graph;
+    }
+
+    /**
+     * Creates graph in sparse storage on arrays, which are not copied and must outlive the graph
+     * @param offsets - n + 1 elements, light neighbours of vertex i are neighbours[offsets[i]..offsets[i + 1])
+     * @param neighbours - sorted list of light neighbours of every vertex, both directions of every edge
+     */
+    static Graph FromCSR(int n, const int *offsets, const int *neighbours) {
+        Graph graph;
+        graph.n = n;
+        graph.dense = false;
+        graph.external_offsets = offsets;
+        graph.external_neighbours = neighbours;
+        return graph;
     }
 
+    /**
+     * Creates graph in dense storage on a matrix of light edges, words of which may be owned by somebody else
+     */
+    static Graph FromBitMatrix(BitMatrix light_edges) {
+        Graph graph;
+        graph.n = light_edges.Size();
+        graph.dense = true;
+        graph.light_edges = std::move(light_edges);
+        return graph;
+    }
+
+    /**
+     * Sets weight of the edge
+     * For sparse storage takes O(degree) time, lists of changed vertexes are looked up in a hash table afterwards,
+     * until ApplyPatches is called
+     */
     void AddEdge(int first_vertex, int second_vertex, int weight) {
-        edges.find(first_vertex)->second.emplace(second_vertex, weight);
-        edges.find(second_vertex)->second.emplace(first_vertex, weight);
+        if (!dense) {
+            PatchRow(first_vertex, second_vertex, weight);
+            PatchRow(second_vertex, first_vertex, weight);
+            return;
+        }
+        if (weight == LIGHT_EDGE) {
+            light_edges.Set(first_vertex, second_vertex);
+            light_edges.Set(second_vertex, first_vertex);
+        } else {
+            light_edges.Reset(first_vertex, second_vertex);
+            light_edges.Reset(second_vertex, first_vertex);
+        }
     }
 
     int GetEdgeWeight(int first_vertex, int second_vertex) const {
-        return edges.find(first_vertex)->second.find(second_vertex)->second;
+        if (dense) {
+            return HEAVY_EDGE - light_edges.Get(first_vertex, second_vertex);
+        }
+        return VisitRow(first_vertex, [&](auto begin, auto end) {
+            return std::binary_search(begin, end, second_vertex) ? LIGHT_EDGE : HEAVY_EDGE;
+        });
     }
 
-    const unordered_map<int, int> &EdgesByVertex(int vertex) {
-        return edges.at(vertex);
+    /**
+     * Sets weights[i] to weight of the edge (first[i], second[i]) for every i in [0, count)
+     *
+     * On a mapped matrix edges are looked up tile by tile in order of rows (see BitMatrix::TileRows),
+     * and the next tile with edges is prefetched while the current one is read, so the file is read forward
+     * instead of a page for every edge at random
+     */
+    void GetEdgeWeights(const int *first, const int *second, int count, char *weights) const {
+        if (!IsMapped()) {
+            for (int i = 0; i < count; ++i) {
+                weights[i] = GetEdgeWeight(first[i], second[i]);
+            }
+            return;
+        }
+        int tile_rows = light_edges.TileRows();
+        int num_tiles = (n + tile_rows - 1) / tile_rows;
+        // counting sort of edges by tiles of first vertexes
+        vector<int> tile_begin(num_tiles + 1, 0);
+        for (int i = 0; i < count; ++i) {
+            tile_begin[first[i] / tile_rows + 1]++;
+        }
+        for (int tile = 0; tile < num_tiles; ++tile) {
+            tile_begin[tile + 1] += tile_begin[tile];
+        }
+        vector<int> order(count);
+        vector<int> position(tile_begin.begin(), tile_begin.end() - 1);
+        for (int i = 0; i < count; ++i) {
+            order[position[first[i] / tile_rows]++] = i;
+        }
+
+        auto next_tile = [&](int tile) {
+            while (tile < num_tiles && tile_begin[tile] == tile_begin[tile + 1]) {
+                ++tile;
+            }
+            return tile;
+        };
+        int tile = next_tile(0);
+        light_edges.Prefetch(tile * tile_rows, (tile + 1) * tile_rows);
+        while (tile < num_tiles) {
+            int following = next_tile(tile + 1);
+            light_edges.Prefetch(following * tile_rows, (following + 1) * tile_rows);
+            for (int k = tile_begin[tile]; k < tile_begin[tile + 1]; ++k) {
+                int i = order[k];
+                weights[i] = HEAVY_EDGE - light_edges.Get(first[i], second[i]);
+            }
+            tile = following;
+        }
     }
 
-    const unordered_map<int, unordered_map<int, int>> &GetEdges() const {
-        return edges;
+    /**
+     * Calls callback(another_vertex) for every edge of weight 1 going from vertex
+     */
+    template<typename Callback>
+    void ForEachLightNeighbour(int vertex, Callback &&callback) const {
+        if (dense) {
+            light_edges.ForEachInRow(vertex, std::forward<Callback>(callback));
+            return;
+        }
+        VisitRow(vertex, [&](auto begin, auto end) {
+            for (auto neighbour = begin; neighbour != end; ++neighbour) {
+                callback(static_cast<int>(*neighbour));
+            }
+        });
+    }
+
+    int LightDegree(int vertex) const {
+        if (dense) {
+            return light_edges.CountInRow(vertex);
+        }
+        return VisitRow(vertex, [](auto begin, auto end) {
+            return static_cast<int>(end - begin);
+        });
+    }
+
+    /**
+     * Moves lists changed by AddEdge from patched_rows into the arrays of sparse storage,
+     * so that lookups of the changed vertexes don't go through the hash table
+     * Takes O(n + m) time, arrays given to FromCSR are copied, does nothing for dense storage
+     */
+    void ApplyPatches() {
+        if (patched_rows.empty()) {
+            return;
+        }
+        vector<int> patched_vertexes;
+        patched_vertexes.reserve(patched_rows.size());
+        for (const auto &row: patched_rows) {
+            patched_vertexes.push_back(row.first);
+        }
+        std::sort(patched_vertexes.begin(), patched_vertexes.end());
+
+        const int *old_offsets = Offsets();
+        vector<int> new_offsets(n + 1, 0);
+        auto patched = patched_vertexes.begin();
+        for (int vertex = 0; vertex < n; ++vertex) {
+            int degree = old_offsets[vertex + 1] - old_offsets[vertex];
+            if (patched != patched_vertexes.end() && *patched == vertex) {
+                degree = patched_rows[vertex].size();
+                ++patched;
+            }
+            new_offsets[vertex + 1] = new_offsets[vertex] + degree;
+        }
+        if (IsNarrow()) {
+            narrow_neighbours = CopyRows(narrow_neighbours.data(), new_offsets, patched_vertexes);
+        } else {
+            neighbours = CopyRows(Neighbours(), new_offsets, patched_vertexes);
+        }
+        offsets = std::move(new_offsets);
+        external_offsets = nullptr;
+        external_neighbours = nullptr;
+        patched_rows.clear();
+        patched_size = 0;
+    }
+
+    /**
+     * @return number of vertexes in lists changed by AddEdge since the last ApplyPatches, 0 for dense storage
+     */
+    size_t PatchedSize() const {
+        return patched_size;
+    }
+
+    /**
+     * @return number of vertexes in lists of the arrays of sparse storage, twice the number of light edges in them,
+     * 0 for dense storage
+     */
+    size_t ArraysSize() const {
+        return dense ? 0 : Offsets()[n];
+    }
+
+    int Size() const {
+        return n;
+    }
+
+    bool IsDense() const {
+        return dense;
+    }
+
+    /**
+     * @return true for dense storage on a matrix not owned by the graph, e.g. mapped from a file,
+     * rows of which should be read in order and prefetched
+     */
+    bool IsMapped() const {
+        return dense && light_edges.IsExternal();
+    }
+
+    /**
+     * @return size in bytes of a vertex in lists of sparse storage, 0 for dense storage
+     */
+    int IndexBytes() const {
+        if (dense) {
+            return 0;
+        }
+        return IsNarrow() ? sizeof(NarrowIndex) : sizeof(int);
+    }
+
+    /**
+     * @return matrix of light edges, works only for dense storage
+     */
+    const BitMatrix &GetLightEdges() const {
+        assert(dense);
+        return light_edges;
     }
 private:
-    unordered_map<int, unordered_map<int, int>> edges;
+    Graph() = default;
+
+    bool IsNarrow() const {
+        return narrow;
+    }
+
+    const int *Offsets() const {
+        return external_offsets != nullptr ? external_offsets : offsets.data();
+    }
+
+    const int *Neighbours() const {
+        return external_offsets != nullptr ? external_neighbours : neighbours.data();
+    }
+
+    /**
+     * Calls visit(begin, end) for sorted light neighbours of vertex in sparse storage,
+     * begin and end are pointers to NarrowIndex or to int
+     * @return result of visit
+     */
+    template<typename Visit>
+    auto VisitRow(int vertex, Visit &&visit) const -> decltype(visit(static_cast<const int *>(nullptr),
+                                                                     static_cast<const int *>(nullptr))) {
+        if (!patched_rows.empty()) {
+            auto patched = patched_rows.find(vertex);
+            if (patched != patched_rows.end()) {
+                return visit(patched->second.data(), patched->second.data() + patched->second.size());
+            }
+        }
+        const int *offsets = Offsets();
+        if (IsNarrow()) {
+            return visit(narrow_neighbours.data() + offsets[vertex], narrow_neighbours.data() + offsets[vertex + 1]);
+        }
+        return visit(Neighbours() + offsets[vertex], Neighbours() + offsets[vertex + 1]);
+    }
+
+    /**
+     * @return lists of all vertexes placed by new_offsets: lists of patched_vertexes from patched_rows,
+     * other lists from old_neighbours placed by the current offsets
+     */
+    template<typename Index>
+    vector<Index> CopyRows(const Index *old_neighbours, const vector<int> &new_offsets,
+                           const vector<int> &patched_vertexes) const {
+        const int *old_offsets = Offsets();
+        vector<Index> rows(new_offsets[n]);
+        auto patched = patched_vertexes.begin();
+        for (int vertex = 0; vertex < n; ++vertex) {
+            if (patched != patched_vertexes.end() && *patched == vertex) {
+                const auto &row = patched_rows.at(vertex);
+                std::copy(row.begin(), row.end(), rows.begin() + new_offsets[vertex]);
+                ++patched;
+            } else {
+                std::copy(old_neighbours + old_offsets[vertex], old_neighbours + old_offsets[vertex + 1],
+                          rows.begin() + new_offsets[vertex]);
+            }
+        }
+        return rows;
+    }
+
+    /**
+     * Adds another_vertex to the list of vertex or removes it from the list, if weight is heavy
+     */
+    void PatchRow(int vertex, int another_vertex, int weight) {
+        auto patched = patched_rows.find(vertex);
+        if (patched == patched_rows.end()) {
+            patched = patched_rows.emplace(vertex, VisitRow(vertex, [](auto begin, auto end) {
+                return vector<int>(begin, end);
+            })).first;
+            patched_size += patched->second.size();
+        }
+        auto &row = patched->second;
+        auto it = std::lower_bound(row.begin(), row.end(), another_vertex);
+        bool light = it != row.end() && *it == another_vertex;
+        if (weight == LIGHT_EDGE && !light) {
+            row.insert(it, another_vertex);
+            ++patched_size;
+        } else if (weight != LIGHT_EDGE && light) {
+            row.erase(it);
+            --patched_size;
+        }
+    }
+
+    int n = 0;
+    bool dense = false;
+    BitMatrix light_edges; // dense storage
+    vector<int> offsets; // sparse storage: light neighbours of vertex i are neighbours[offsets[i]..offsets[i + 1])
+    vector<int> neighbours;
+    bool narrow = false; // sparse storage is in narrow_neighbours, chosen by FromLightEdges
+    vector<NarrowIndex> narrow_neighbours; // sparse storage for n <= NARROW_INDEX_VERTEXES instead of neighbours
+    const int *external_offsets = nullptr; // sparse storage in arrays given to FromCSR, instead of offsets
+    const int *external_neighbours = nullptr;
+    unordered_map<int, vector<int>> patched_rows; // sparse storage: lists of vertexes changed by AddEdge
+    size_t patched_size = 0; // total size of lists in patched_rows
 };
 
 
@@ -0,0 +1,162 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_INCREMENTALAPPROXIMATION_H
+#define HELLOWORLD_INCREMENTALAPPROXIMATION_H
+
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <cassert>
+#include <algorithm>
+#include "Graph.h"
+#include "LocalSearch.h"
+#include "TSPApproximation.h"
+#include "TourEvaluator.h"
+
+using std::vector;
+
+/**
+ * Change of weight of one edge
+ */
+struct EdgeUpdate {
+    int first_vertex;
+    int second_vertex;
+    int weight;
+};
+
+/**
+ * Tour of a graph, which changes by small batches of edge weights
+ *
+ * The first tour is built by TSPApproximation. After a batch of updates the tour is kept and repaired
+ * by LocalSearch, which starts only from ends of changed edges. Changed lists of the graph stay in its hash table
+ * of patches, until they grow to MAX_PATCHED_FRACTION of the graph, and only then are moved into its arrays
+ * in O(n + m) (see Graph::ApplyPatches), so an update costs in proportion to the batch, amortized.
+ * Update is only a local repair of the tour: the cycle cover, the matching and the joins of the solve
+ * are not kept and not repaired, and the repaired tour has no bound of accuracy, it may drift from the optimum
+ * with every batch. Rebuild solves from scratch again.
+ * The graph is owned and changed by the approximation, so it can't be moved or copied.
+ */
+class IncrementalApproximation {
+public:
+    /**
+     * Counters of all updates
+     */
+    struct Stats {
+        long long updates = 0; // calls of Update
+        long long changed_edges = 0; // edges, which weights are really changed
+        long long repairs = 0; // updates, which changed weights and were repaired by LocalSearch
+        long long full_solves = 0; // solves from scratch, including the first one
+        long long repair_gain = 0; // decrease of weight of the tour by LocalSearch
+    };
+
+    /**
+     * Builds the first tour, finds cycles which cover all vertexes of a graph by itself (see CycleCover)
+     * Experimental: the cover is found by a heuristic, so tours are not guaranteed to be within 7/6 of the optimum
+     * @param options - options of every solve from scratch, local_search_ms also limits time of one repair
+     */
+    explicit IncrementalApproximation(Graph graph, const ApproximationOptions &options = ApproximationOptions())
+            : graph(std::move(graph)), options(options) {
+        Solve();
+    }
+
+    IncrementalApproximation(const IncrementalApproximation &) = delete;
+
+    IncrementalApproximation &operator=(const IncrementalApproximation &) = delete;
+
+    /**
+     * Changes weights of edges and repairs the tour by local search around the changed edges,
+     * the rest of the tour is kept as it is (see the class)
+     * @return updated tour
+     */
+    const vector<int> &Update(const vector<EdgeUpdate> &updates) {
+        stats.updates++;
+        touched.clear();
+        for (const auto &update: updates) {
+            assert(update.weight == LIGHT_EDGE || update.weight == HEAVY_EDGE);
+            assert(update.first_vertex != update.second_vertex);
+            int old_weight = graph.GetEdgeWeight(update.first_vertex, update.second_vertex);
+            if (old_weight == update.weight) {
+                continue;
+            }
+            stats.changed_edges++;
+            if (local_search->IsTourEdge(update.first_vertex, update.second_vertex)) {
+                weight += update.weight - old_weight;
+            }
+            graph.AddEdge(update.first_vertex, update.second_vertex, update.weight);
+            touched.push_back(update.first_vertex);
+            touched.push_back(update.second_vertex);
+        }
+        if (touched.empty()) {
+            return GetApproximation();
+        }
+        if (graph.PatchedSize() > MAX_PATCHED_FRACTION * (graph.Size() + graph.ArraysSize())) {
+            graph.ApplyPatches();
+        }
+
+        auto deadline = options.local_search_ms > 0
+                        ? std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::duration<double, std::milli>(options.local_search_ms))
+                        : std::chrono::steady_clock::time_point::max();
+        long long gain = local_search->ImproveAround(touched, deadline, EVALUATIONS_PER_CHANGE * touched.size(),
+                                                     MAX_MOVE_DISTANCE);
+        weight -= gain;
+        stats.repair_gain += gain;
+        stats.repairs++;
+        return GetApproximation();
+    }
+
+    /**
+     * Builds the tour of the current graph from scratch, e.g. when repairs made it too heavy
+     * @return new tour
+     */
+    const vector<int> &Rebuild() {
+        Solve();
+        return GetApproximation();
+    }
+
+    const vector<int> &GetApproximation() const {
+        return local_search->GetTour();
+    }
+
+    long long GetWeight() const {
+        return weight;
+    }
+
+    const Graph &GetGraph() const {
+        return graph;
+    }
+
+    const Stats &GetStats() const {
+        return stats;
+    }
+
+private:
+    const static int EVALUATIONS_PER_CHANGE = 16;
+    const static int MAX_MOVE_DISTANCE = 1 << 12;
+    // patches of the graph are moved into its arrays, when their size is this part of n plus the size of the arrays,
+    // so copying of O(n + m) is amortized over updates of at least this part of the graph
+    constexpr static double MAX_PATCHED_FRACTION = 0.05;
+
+    void Solve() {
+        stats.full_solves++;
+        auto tour = TSPApproximation(graph, options).GetApproximation();
+        weight = TourEvaluator().Evaluate(graph, tour).weight;
+        local_search = std::make_unique<LocalSearch>(graph, std::move(tour));
+        // O(n) is paid by the solve, so that updates cost in proportion to their batches
+        local_search->PreparePositions();
+    }
+
+    Graph graph;
+    ApproximationOptions options;
+    std::unique_ptr<LocalSearch> local_search; // keeps the tour and positions of vertexes in it
+    long long weight = 0; // weight of the tour
+    vector<int> touched; // ends of changed edges of the current update
+    Stats stats;
+};
+
+
+#endif //HELLOWORLD_INCREMENTALAPPROXIMATION_H
@@ -0,0 +1,134 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_INDEXARRAY_H
+#define HELLOWORLD_INDEXARRAY_H
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <type_traits>
+
+using std::vector;
+
+/**
+ * Index type of vertexes and cycles of graphs with at most NARROW_INDEX_VERTEXES vertexes
+ * Structures of the construction are templates on index type (int or NarrowIndex), so arrays of indexes
+ * of small graphs take half of memory and bandwidth, see DispatchIndex
+ */
+using NarrowIndex = uint16_t;
+
+// the largest value of NarrowIndex encodes -1, so it is not a vertex
+const static int NARROW_INDEX_VERTEXES = std::numeric_limits<NarrowIndex>::max();
+
+/**
+ * @return value stored as Index, -1 is stored as the largest value of an unsigned Index
+ */
+template<typename Index>
+Index ToIndex(int value) {
+    if constexpr (std::is_signed<Index>::value) {
+        return value;
+    } else {
+        assert(value >= -1 && value < std::numeric_limits<Index>::max());
+        return static_cast<Index>(value);
+    }
+}
+
+/**
+ * @return value stored by ToIndex
+ */
+template<typename Index>
+int FromIndex(Index value) {
+    if constexpr (std::is_signed<Index>::value) {
+        return value;
+    } else {
+        return value == std::numeric_limits<Index>::max() ? -1 : value;
+    }
+}
+
+/**
+ * Calls function(Index()) with the narrowest index type, which fits vertexes 0..n-1 (NarrowIndex or int)
+ * @return result of function
+ */
+template<typename Function>
+decltype(auto) DispatchIndex(int n, Function &&function) {
+    if (n <= NARROW_INDEX_VERTEXES) {
+        return function(NarrowIndex());
+    }
+    return function(int());
+}
+
+/**
+ * Array of indexes (or -1) stored as Index, read and written as int
+ * For int it is a plain vector, for an unsigned Index elements are written through a proxy reference,
+ * which converts -1 (see ToIndex), so code of a structure is the same for every index type
+ */
+template<typename Index>
+class IndexArray {
+public:
+    class Reference {
+    public:
+        explicit Reference(Index *value) : value(value) {}
+
+        operator int() const {
+            return FromIndex(*value);
+        }
+
+        Reference &operator=(int new_value) {
+            *value = ToIndex<Index>(new_value);
+            return *this;
+        }
+
+        Reference &operator=(const Reference &other) {
+            *value = *other.value;
+            return *this;
+        }
+
+    private:
+        Index *value;
+    };
+
+    using ElementReference = std::conditional_t<std::is_same<Index, int>::value, int &, Reference>;
+
+    ElementReference operator[](size_t i) {
+        if constexpr (std::is_same<Index, int>::value) {
+            return values[i];
+        } else {
+            return Reference(&values[i]);
+        }
+    }
+
+    int operator[](size_t i) const {
+        return FromIndex(values[i]);
+    }
+
+    void assign(size_t n, int value) {
+        values.assign(n, ToIndex<Index>(value));
+    }
+
+    void resize(size_t n, int value = 0) {
+        values.resize(n, ToIndex<Index>(value));
+    }
+
+    void clear() {
+        values.clear();
+    }
+
+    size_t size() const {
+        return values.size();
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+private:
+    vector<Index> values;
+};
+
+
+#endif //HELLOWORLD_INDEXARRAY_H
@@ -0,0 +1,241 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_INSTANCEFILE_H
+#define HELLOWORLD_INSTANCEFILE_H
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <cassert>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Graph.h"
+#include "Cycle.h"
+
+using std::vector;
+using std::string;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "InstanceFile is stored in little-endian byte order");
+
+/**
+ * Binary file with an instance: light edges of a graph and cycles, which cover all its vertexes
+ *
+ * Layout, numbers are little-endian, every array starts at a multiple of 8 bytes:
+ * Header
+ * int32 offsets[num_vertexes + 1] - light neighbours of vertex i are neighbours[offsets[i]..offsets[i + 1])
+ * int32 neighbours[num_neighbours] - sorted light neighbours of every vertex, both directions of every edge
+ * int32 cycle_offsets[num_cycles + 1] - cycle i is cycle_vertexes[cycle_offsets[i]..cycle_offsets[i + 1])
+ * int32 cycle_vertexes[num_vertexes] - permutation of vertexes
+ *
+ * Open maps the file read-only, graph and cycles point straight into the mapping, nothing is parsed or copied.
+ * Pages are read by the kernel on the first access, so opening takes the same time for any size of the file.
+ */
+class InstanceFile {
+public:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t num_vertexes;
+        uint64_t num_neighbours;
+        uint64_t num_cycles;
+        uint64_t file_size;
+    };
+
+    constexpr static char MAGIC[8] = {'T', 'S', 'P', '1', '2', 'B', 'I', 'N'};
+    constexpr static uint32_t VERSION = 1;
+
+    /**
+     * @param cycles - cycles, which cover all vertexes of the graph
+     * throws std::runtime_error if the file can't be written
+     */
+    static void Write(const string &path, const Graph &graph, const vector<vector<int>> &cycles) {
+        int n = graph.Size();
+        vector<int> offsets(n + 1, 0);
+        vector<int> neighbours;
+        for (int vertex = 0; vertex < n; ++vertex) {
+            graph.ForEachLightNeighbour(vertex, [&](int another_vertex) {
+                neighbours.push_back(another_vertex);
+            });
+            offsets[vertex + 1] = neighbours.size();
+        }
+        vector<int> cycle_offsets(1, 0);
+        vector<int> cycle_vertexes;
+        cycle_vertexes.reserve(n);
+        for (const auto &cycle: cycles) {
+            cycle_vertexes.insert(cycle_vertexes.end(), cycle.begin(), cycle.end());
+            cycle_offsets.push_back(cycle_vertexes.size());
+        }
+        assert(cycle_vertexes.size() == static_cast<size_t>(n));
+
+        Layout layout(n, neighbours.size(), cycles.size());
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.num_vertexes = n;
+        header.num_neighbours = neighbours.size();
+        header.num_cycles = cycles.size();
+        header.file_size = layout.file_size;
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("can't open " + path + " for writing");
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        WriteArray(out, layout.offsets, offsets);
+        WriteArray(out, layout.neighbours, neighbours);
+        WriteArray(out, layout.cycle_offsets, cycle_offsets);
+        WriteArray(out, layout.cycle_vertexes, cycle_vertexes);
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("can't write " + path);
+        }
+    }
+
+    /**
+     * Maps the file, checks header and sizes of arrays (but not their contents)
+     * throws std::runtime_error if the file can't be mapped or is not a valid instance
+     */
+    static InstanceFile Open(const string &path) {
+        InstanceFile file;
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor == -1) {
+            throw std::runtime_error("can't open " + path);
+        }
+        struct stat file_stat{};
+        if (fstat(descriptor, &file_stat) == -1 || file_stat.st_size < static_cast<off_t>(sizeof(Header))) {
+            close(descriptor);
+            throw std::runtime_error(path + " is not an instance file");
+        }
+        file.size = file_stat.st_size;
+        file.data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        close(descriptor);
+        if (file.data == MAP_FAILED) {
+            file.data = nullptr;
+            throw std::runtime_error("can't map " + path);
+        }
+
+        const auto *bytes = static_cast<const char *>(file.data);
+        const auto &header = *reinterpret_cast<const Header *>(bytes);
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.num_vertexes >= INT_MAX || header.num_neighbours >= INT_MAX || header.num_cycles > header.num_vertexes) {
+            throw std::runtime_error(path + " is not an instance file");
+        }
+        Layout layout(header.num_vertexes, header.num_neighbours, header.num_cycles);
+        if (header.file_size != file.size || layout.file_size != file.size) {
+            throw std::runtime_error(path + " has wrong size");
+        }
+        file.num_vertexes = header.num_vertexes;
+        file.num_cycles = header.num_cycles;
+        file.offsets = reinterpret_cast<const int *>(bytes + layout.offsets);
+        file.neighbours = reinterpret_cast<const int *>(bytes + layout.neighbours);
+        file.cycle_offsets = reinterpret_cast<const int *>(bytes + layout.cycle_offsets);
+        file.cycle_vertexes = reinterpret_cast<const int *>(bytes + layout.cycle_vertexes);
+        if (file.offsets[0] != 0 || static_cast<uint64_t>(file.offsets[file.num_vertexes]) != header.num_neighbours ||
+            file.cycle_offsets[0] != 0 || file.cycle_offsets[file.num_cycles] != file.num_vertexes) {
+            throw std::runtime_error(path + " has wrong offsets");
+        }
+        return file;
+    }
+
+    InstanceFile(InstanceFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    InstanceFile &operator=(InstanceFile &&other) noexcept {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        std::swap(num_vertexes, other.num_vertexes);
+        std::swap(num_cycles, other.num_cycles);
+        std::swap(offsets, other.offsets);
+        std::swap(neighbours, other.neighbours);
+        std::swap(cycle_offsets, other.cycle_offsets);
+        std::swap(cycle_vertexes, other.cycle_vertexes);
+        return *this;
+    }
+
+    InstanceFile(const InstanceFile &) = delete;
+
+    InstanceFile &operator=(const InstanceFile &) = delete;
+
+    ~InstanceFile() {
+        if (data != nullptr) {
+            munmap(data, size);
+        }
+    }
+
+    /**
+     * @return graph on the mapped arrays, valid while the file is open
+     */
+    Graph GetGraph() const {
+        return Graph::FromCSR(num_vertexes, offsets, neighbours);
+    }
+
+    /**
+     * @return cycles on the mapped arrays, valid while the file is open
+     */
+    FlatCycles GetCycles() const {
+        return {num_cycles, cycle_offsets, cycle_vertexes};
+    }
+
+    int NumVertexes() const {
+        return num_vertexes;
+    }
+
+private:
+    /**
+     * Offsets of arrays in the file
+     */
+    struct Layout {
+        Layout(uint64_t num_vertexes, uint64_t num_neighbours, uint64_t num_cycles) {
+            offsets = Align(sizeof(Header));
+            neighbours = Align(offsets + (num_vertexes + 1) * sizeof(int));
+            cycle_offsets = Align(neighbours + num_neighbours * sizeof(int));
+            cycle_vertexes = Align(cycle_offsets + (num_cycles + 1) * sizeof(int));
+            file_size = cycle_vertexes + num_vertexes * sizeof(int);
+        }
+
+        static uint64_t Align(uint64_t offset) {
+            return (offset + 7) / 8 * 8;
+        }
+
+        uint64_t offsets;
+        uint64_t neighbours;
+        uint64_t cycle_offsets;
+        uint64_t cycle_vertexes;
+        uint64_t file_size;
+    };
+
+    InstanceFile() = default;
+
+    /**
+     * Writes zero padding up to position and then array
+     */
+    static void WriteArray(std::ofstream &out, uint64_t position, const vector<int> &array) {
+        static const char zeros[8] = {};
+        out.write(zeros, position - static_cast<uint64_t>(out.tellp()));
+        out.write(reinterpret_cast<const char *>(array.data()), array.size() * sizeof(int));
+    }
+
+    void *data = nullptr;
+    size_t size = 0;
+    int num_vertexes = 0;
+    int num_cycles = 0;
+    const int *offsets = nullptr;
+    const int *neighbours = nullptr;
+    const int *cycle_offsets = nullptr;
+    const int *cycle_vertexes = nullptr;
+};
+
+
+#endif //HELLOWORLD_INSTANCEFILE_H
@@ -0,0 +1,436 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_INSTANCEGENERATOR_H
+#define HELLOWORLD_INSTANCEGENERATOR_H
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "ThreadPool.h"
+
+using std::vector;
+using std::pair;
+using std::string;
+
+/**
+ * Counter-based random generator: number k of stream s is a hash of (seed, s, k)
+ *
+ * Any number is computed without the previous ones, so parts of an instance generated by different threads
+ * from their own streams don't depend on the number of threads or the order of work.
+ * The hash is the finalizer of SplitMix64. Satisfies UniformRandomBitGenerator.
+ */
+class CounterRandom {
+public:
+    using result_type = uint64_t;
+
+    explicit CounterRandom(uint64_t seed, uint64_t stream = 0) : key(Mix(Mix(seed) ^ (stream * GAMMA + GAMMA))) {}
+
+    /**
+     * @return number counter of the stream
+     */
+    uint64_t At(uint64_t counter) const {
+        return Mix(key + counter * GAMMA);
+    }
+
+    uint64_t operator()() {
+        return At(counter++);
+    }
+
+    /**
+     * @return uniform number in [0, bound), without the bias of a modulo (Lemire's method), bound > 0
+     */
+    uint64_t Below(uint64_t bound) {
+        unsigned __int128 product = static_cast<unsigned __int128>((*this)()) * bound;
+        auto low = static_cast<uint64_t>(product);
+        if (low < bound) {
+            uint64_t threshold = -bound % bound;
+            while (low < threshold) {
+                product = static_cast<unsigned __int128>((*this)()) * bound;
+                low = static_cast<uint64_t>(product);
+            }
+        }
+        return product >> 64;
+    }
+
+    /**
+     * @return uniform number in [0, 1)
+     */
+    double Uniform() {
+        return ((*this)() >> 11) * 0x1.0p-53;
+    }
+
+    static constexpr uint64_t min() {
+        return 0;
+    }
+
+    static constexpr uint64_t max() {
+        return UINT64_MAX;
+    }
+
+private:
+    const static uint64_t GAMMA = 0x9e3779b97f4a7c15ULL;
+
+    static uint64_t Mix(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t key;
+    uint64_t counter = 0;
+};
+
+/**
+ * Structure of a generated instance, noise of random light edges (extra_degree, density_percent) is added to any
+ */
+enum class InstanceFamily {
+    PLANTED_TOUR, // light Hamiltonian tour with some heavy edges, cover is the tour cut on num_cycles cycles
+    RANDOM_COVER, // cycles of random length around cycle_length with some heavy edges
+    CLUSTERED, // planted tour, vertexes of every cluster_size consecutive vertexes of the tour are densely connected
+    DEEP_TREES // cycles of length 4 joined by single light edges in trees, stresses splitting of components
+};
+
+struct GeneratorOptions {
+    InstanceFamily family = InstanceFamily::RANDOM_COVER;
+    int num_vertexes = 1000;
+    uint64_t seed = 1; // the same options give the same instance for any number of threads
+    double heavy_percent = 5; // percent of heavy edges of the planted tour or of the cover
+    double extra_degree = 2; // average number of random light edges of a vertex
+    double density_percent = 0; // every pair of vertexes is made light with this probability
+    int num_cycles = 0; // PLANTED_TOUR, CLUSTERED: cycles of the cover, 0 - no cover
+    int cycle_length = 8; // RANDOM_COVER: average length of a cycle
+    int cluster_size = 64; // CLUSTERED
+    double cluster_degree = 8; // CLUSTERED: average number of light edges of a vertex inside its cluster
+    int tree_cycles = 64; // DEEP_TREES: cycles in one tree
+    int tree_fanout = 4; // DEEP_TREES: children of a cycle, 1 - trees are paths
+    int threads = 1; // threads of the noise, 0 - all hardware threads; the structure is always generated by one
+};
+
+/**
+ * Instance in sparse form, ready for Graph::FromLightEdges
+ */
+struct GeneratedInstance {
+    int num_vertexes = 0;
+    vector<pair<int, int>> light_edges; // may repeat, Graph::FromLightEdges removes repeated edges
+    vector<vector<int>> cycles; // cover of all vertexes, empty if the family has no cover
+    vector<int> planted_tour; // tour, which weight bounds the optimum, empty if the family has no tour
+};
+
+/**
+ * Generator of families of instances of size up to millions of vertexes
+ *
+ * Only the noise is parallel. Structure of a family (permutation, tour, cover, heavy edges) is sequential:
+ * it is built by the calling thread from stream 0 in O(n), because the shuffle and the exact number of heavy edges
+ * (ChooseExactly) depend on all previous numbers of the stream.
+ * Noise is generated by blocks of BLOCK_SIZE vertexes on a pool of threads, each block from its own stream,
+ * and blocks are concatenated in order. Pairs for density_percent are sampled by geometric skips,
+ * so time is proportional to the number of edges, not to the number of pairs.
+ */
+class InstanceGenerator {
+public:
+    static GeneratedInstance Generate(const GeneratorOptions &options) {
+        return InstanceGenerator(options).Generate();
+    }
+
+    /**
+     * @return family by its name: planted, cover, clustered or trees
+     * throws std::invalid_argument for other names
+     */
+    static InstanceFamily ParseFamily(const string &name) {
+        if (name == "planted") {
+            return InstanceFamily::PLANTED_TOUR;
+        } else if (name == "cover") {
+            return InstanceFamily::RANDOM_COVER;
+        } else if (name == "clustered") {
+            return InstanceFamily::CLUSTERED;
+        } else if (name == "trees") {
+            return InstanceFamily::DEEP_TREES;
+        }
+        throw std::invalid_argument("unknown family of instances " + name);
+    }
+
+private:
+    constexpr static int BLOCK_SIZE = 1 << 14;
+    constexpr static int MIN_CYCLE_LENGTH = 4;
+
+    explicit InstanceGenerator(const GeneratorOptions &options) : options(options), random(options.seed) {
+        instance.num_vertexes = options.num_vertexes;
+    }
+
+    GeneratedInstance Generate() {
+        int n = options.num_vertexes;
+        if (n < MIN_CYCLE_LENGTH) {
+            throw std::invalid_argument("instance must have at least 4 vertexes");
+        }
+        vector<int> permutation = RandomPermutation(n);
+        switch (options.family) {
+            case InstanceFamily::PLANTED_TOUR:
+            case InstanceFamily::CLUSTERED:
+                PlantTour(permutation);
+                break;
+            case InstanceFamily::RANDOM_COVER:
+                AddRandomCover(permutation);
+                break;
+            case InstanceFamily::DEEP_TREES:
+                AddTrees(permutation);
+                break;
+        }
+        AddNoise(permutation);
+        return std::move(instance);
+    }
+
+    /**
+     * Fisher-Yates shuffle
+     */
+    vector<int> RandomPermutation(int n) {
+        vector<int> permutation(n);
+        for (int i = 0; i < n; ++i) {
+            permutation[i] = i;
+        }
+        for (int i = n - 1; i > 0; --i) {
+            std::swap(permutation[i], permutation[random.Below(i + 1)]);
+        }
+        return permutation;
+    }
+
+    /**
+     * Calls choose(index, chosen) for index in [0, size), exactly count indexes are chosen,
+     * every subset of count indexes with the same probability (selection sampling)
+     */
+    template<typename Choose>
+    void ChooseExactly(long long size, long long count, Choose &&choose) {
+        for (long long index = 0; index < size; ++index) {
+            bool chosen = static_cast<long long>(random.Below(size - index)) < count;
+            count -= chosen;
+            choose(index, chosen);
+        }
+    }
+
+    long long HeavyCount(long long edges) const {
+        return std::min(edges, std::max(0LL, std::llround(edges * options.heavy_percent / 100)));
+    }
+
+    /**
+     * Edges of the tour permutation are light except the heavy ones, the tour is cut on num_cycles cycles:
+     * every cycle is closed by an edge of the same weight as the edge of the tour coming into the cycle,
+     * so the cover weighs as much as the tour
+     */
+    void PlantTour(const vector<int> &tour) {
+        int n = tour.size();
+        vector<bool> light(n);
+        ChooseExactly(n, HeavyCount(n), [&](long long index, bool heavy) {
+            light[index] = !heavy;
+            if (!heavy) {
+                instance.light_edges.emplace_back(tour[index], tour[index + 1 == n ? 0 : index + 1]);
+            }
+        });
+        instance.planted_tour = tour;
+
+        int num_cycles = std::min(options.num_cycles, n / MIN_CYCLE_LENGTH);
+        if (num_cycles <= 0) {
+            return;
+        }
+        // lengths are MIN_CYCLE_LENGTH plus a uniform composition of the rest: free vertexes and bars between cycles
+        int free_vertexes = n - num_cycles * MIN_CYCLE_LENGTH;
+        int begin = 0;
+        int length = MIN_CYCLE_LENGTH;
+        ChooseExactly(free_vertexes + num_cycles - 1, num_cycles - 1, [&](long long, bool bar) {
+            if (!bar) {
+                ++length;
+                return;
+            }
+            AddTourCycle(tour, light, begin, begin + length);
+            begin += length;
+            length = MIN_CYCLE_LENGTH;
+        });
+        AddTourCycle(tour, light, begin, n);
+    }
+
+    /**
+     * Adds tour[begin..end) to the cover
+     * @param light - weights of edges of the tour, light[i] for (tour[i], tour[i + 1])
+     */
+    void AddTourCycle(const vector<int> &tour, const vector<bool> &light, int begin, int end) {
+        instance.cycles.emplace_back(tour.begin() + begin, tour.begin() + end);
+        int n = tour.size();
+        int coming = begin == 0 ? n - 1 : begin - 1;
+        if (end - begin < n && light[coming]) {
+            instance.light_edges.emplace_back(tour[end - 1], tour[begin]);
+        }
+    }
+
+    void AddRandomCover(const vector<int> &permutation) {
+        int n = permutation.size();
+        int max_length = std::max(MIN_CYCLE_LENGTH, 2 * options.cycle_length - MIN_CYCLE_LENGTH);
+        vector<int> cycle_begin;
+        int begin = 0;
+        while (begin < n) {
+            cycle_begin.push_back(begin);
+            int end = std::min(n, begin + MIN_CYCLE_LENGTH +
+                                  static_cast<int>(random.Below(max_length - MIN_CYCLE_LENGTH + 1)));
+            if (n - end < MIN_CYCLE_LENGTH) {
+                end = n;
+            }
+            instance.cycles.emplace_back(permutation.begin() + begin, permutation.begin() + end);
+            begin = end;
+        }
+        cycle_begin.push_back(n);
+
+        int cycle = 0;
+        ChooseExactly(n, HeavyCount(n), [&](long long index, bool heavy) {
+            if (index == cycle_begin[cycle + 1]) {
+                ++cycle;
+            }
+            long long next = index + 1 == cycle_begin[cycle + 1] ? cycle_begin[cycle] : index + 1;
+            if (!heavy) {
+                instance.light_edges.emplace_back(permutation[index], permutation[next]);
+            }
+        });
+    }
+
+    /**
+     * Cycles of length 4 (the last one up to 7) in trees of tree_cycles cycles: child number k of a cycle
+     * has a light edge to its vertex number k, so with tree_fanout 4 every vertex of a parent is taken by a child
+     */
+    void AddTrees(const vector<int> &permutation) {
+        int n = permutation.size();
+        int num_cycles = n / MIN_CYCLE_LENGTH;
+        int fanout = std::max(1, options.tree_fanout);
+        int tree_cycles = std::max(1, options.tree_cycles);
+        auto cycle_begin = [&](int cycle) {
+            return cycle == num_cycles ? n : cycle * MIN_CYCLE_LENGTH;
+        };
+        for (int cycle = 0; cycle < num_cycles; ++cycle) {
+            instance.cycles.emplace_back(permutation.begin() + cycle_begin(cycle),
+                                         permutation.begin() + cycle_begin(cycle + 1));
+        }
+
+        ChooseExactly(n, HeavyCount(n), [&](long long index, bool heavy) {
+            int cycle = std::min<int>(index / MIN_CYCLE_LENGTH, num_cycles - 1);
+            long long next = index + 1 == cycle_begin(cycle + 1) ? cycle_begin(cycle) : index + 1;
+            if (!heavy) {
+                instance.light_edges.emplace_back(permutation[index], permutation[next]);
+            }
+        });
+
+        for (int cycle = 0; cycle < num_cycles; ++cycle) {
+            int in_tree = cycle % tree_cycles;
+            if (in_tree == 0) {
+                continue;
+            }
+            int parent = cycle - in_tree + (in_tree - 1) / fanout;
+            int parent_size = cycle_begin(parent + 1) - cycle_begin(parent);
+            int parent_vertex = permutation[cycle_begin(parent) + (in_tree - 1) % fanout % parent_size];
+            int size = cycle_begin(cycle + 1) - cycle_begin(cycle);
+            int vertex = permutation[cycle_begin(cycle) + random.Below(size)];
+            instance.light_edges.emplace_back(vertex, parent_vertex);
+        }
+    }
+
+    /**
+     * Adds random light edges: extra_degree, density_percent and edges inside clusters, block by block
+     */
+    void AddNoise(const vector<int> &permutation) {
+        int n = options.num_vertexes;
+        int num_blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        vector<vector<pair<int, int>>> block_edges(num_blocks);
+        auto generate = [&](int block) {
+            CounterRandom block_random(options.seed, block + 1);
+            AddNoise(permutation, block * BLOCK_SIZE, std::min(n, (block + 1) * BLOCK_SIZE), block_random,
+                     block_edges[block]);
+        };
+        if (options.threads == 1) {
+            for (int block = 0; block < num_blocks; ++block) {
+                generate(block);
+            }
+        } else {
+            ThreadPool pool(options.threads);
+            for (int block = 0; block < num_blocks; ++block) {
+                pool.Submit([&, block] { generate(block); });
+            }
+            pool.Wait();
+        }
+
+        size_t size = instance.light_edges.size();
+        for (const auto &edges: block_edges) {
+            size += edges.size();
+        }
+        instance.light_edges.reserve(size);
+        for (auto &edges: block_edges) {
+            instance.light_edges.insert(instance.light_edges.end(), edges.begin(), edges.end());
+            edges = vector<pair<int, int>>();
+        }
+    }
+
+    /**
+     * Noise of vertexes [begin, end)
+     */
+    void AddNoise(const vector<int> &permutation, int begin, int end, CounterRandom &block_random,
+                  vector<pair<int, int>> &edges) const {
+        int n = options.num_vertexes;
+        // every edge has two ends, so a vertex starts half of its degree
+        auto half_degree = [&](double degree) {
+            double half = degree / 2;
+            return static_cast<int>(half) + (block_random.Uniform() < half - std::floor(half));
+        };
+        for (int vertex = begin; vertex < end; ++vertex) {
+            for (int i = half_degree(options.extra_degree); i > 0; --i) {
+                auto another_vertex = static_cast<int>(block_random.Below(n - 1));
+                edges.emplace_back(vertex, another_vertex + (another_vertex >= vertex));
+            }
+        }
+
+        if (options.family == InstanceFamily::CLUSTERED && options.cluster_size > 1) {
+            // begin and end are positions in the tour here, clusters are ranges of positions
+            for (int position = begin; position < end; ++position) {
+                int cluster_begin = position / options.cluster_size * options.cluster_size;
+                int cluster_size = std::min(n, cluster_begin + options.cluster_size) - cluster_begin;
+                if (cluster_size < 2) {
+                    continue;
+                }
+                for (int i = half_degree(options.cluster_degree); i > 0; --i) {
+                    auto another_position = cluster_begin + static_cast<int>(block_random.Below(cluster_size - 1));
+                    another_position += another_position >= position;
+                    edges.emplace_back(permutation[position], permutation[another_position]);
+                }
+            }
+        }
+
+        double probability = options.density_percent / 100;
+        if (probability >= 1) {
+            for (int vertex = begin; vertex < end; ++vertex) {
+                for (int another_vertex = vertex + 1; another_vertex < n; ++another_vertex) {
+                    edges.emplace_back(vertex, another_vertex);
+                }
+            }
+        } else if (probability > 0) {
+            // pairs (vertex, another_vertex > vertex), the gap to the next light pair is geometric
+            double log_heavy = std::log1p(-probability);
+            for (int vertex = begin; vertex < end; ++vertex) {
+                long long another_vertex = vertex;
+                while (true) {
+                    double gap = std::floor(std::log(1 - block_random.Uniform()) / log_heavy);
+                    if (gap >= n - another_vertex - 1) {
+                        break;
+                    }
+                    another_vertex += 1 + static_cast<long long>(gap);
+                    edges.emplace_back(vertex, another_vertex);
+                }
+            }
+        }
+    }
+
+    GeneratorOptions options;
+    CounterRandom random; // stream 0, structure of the family
+    GeneratedInstance instance;
+};
+
+
+#endif //HELLOWORLD_INSTANCEGENERATOR_H
@@ -0,0 +1,431 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_LOCALSEARCH_H
+#define HELLOWORLD_LOCALSEARCH_H
+
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cassert>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <initializer_list>
+#include "Graph.h"
+
+using std::vector;
+
+/**
+ * Improves a tour by 2-opt and Or-opt moves, which remove heavy edges
+ *
+ * Tour is stored as an array of vertexes and positions of vertexes in it, so next and prev are O(1),
+ * and a segment is reversed in place, from the side which is shorter. Only moves which remove a heavy edge
+ * and add edges to light neighbours of its ends are tried, each applied move decreases weight of the tour.
+ * Vertexes, which are ends of heavy edges, are kept in a work list, search stops when the list is empty
+ * or when the time is over.
+ */
+class LocalSearch {
+public:
+    /**
+     * Counters of the last call of Improve
+     */
+    struct Stats {
+        long long heavy_before = 0; // heavy edges in the tour, -1 if time is over before they are counted
+        long long heavy_after = 0;
+        long long two_opt_moves = 0;
+        long long or_opt_moves = 0;
+        long long evaluations = 0; // vertexes taken from the work list
+        bool timed_out = false;
+    };
+
+    LocalSearch(const Graph &graph, vector<int> tour) : graph(graph), tour(std::move(tour)) {}
+
+    vector<int> Improve(std::chrono::nanoseconds budget) {
+        return Improve(std::chrono::steady_clock::now() + budget);
+    }
+
+    /**
+     * Runs local search until there is no improving move or the deadline
+     * Preparation is done before the deadline too: time is checked every CHECK_PERIOD vertexes of preparation
+     * and before every evaluation of a vertex, so the deadline is exceeded at most by one evaluation with its move
+     * The move is not bounded by max_distance here: its reversal takes up to n / 2 swaps and the evaluation scans
+     * whole lists of light neighbours, so the overrun is O(n + maximum degree), about 2.5 ms for 10^6 vertexes
+     * Should be called once, the tour is moved out
+     * @return improved tour
+     */
+    vector<int> Improve(std::chrono::steady_clock::time_point deadline) {
+        stats = Stats();
+        gain = 0;
+        max_evaluations = LLONG_MAX;
+        max_distance = INT_MAX;
+        int n = tour.size();
+        position.resize(graph.Size());
+        in_work_list.assign(graph.Size(), false);
+        for (int i = 0; i < n; ++i) {
+            position[tour[i]] = i;
+            if (i % CHECK_PERIOD == 0 && IsOver(deadline)) {
+                stats.heavy_before = stats.heavy_after = -1;
+                return std::move(tour);
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            if (Weight(tour[i], tour[i + 1 == n ? 0 : i + 1]) == HEAVY_EDGE) {
+                stats.heavy_before++;
+                Push(tour[i]);
+                Push(tour[i + 1 == n ? 0 : i + 1]);
+            }
+            if (i % CHECK_PERIOD == 0 && IsOver(deadline)) {
+                // number of heavy edges is not known
+                stats.heavy_before = stats.heavy_after = -1;
+                ClearWorkList();
+                return std::move(tour);
+            }
+        }
+        RunWorkList(deadline);
+        // every move decreases number of heavy edges by its gain
+        stats.heavy_after = stats.heavy_before - gain;
+        return std::move(tour);
+    }
+
+    /**
+     * Repairs the tour after weights of some edges are changed in the graph: search starts only from vertexes,
+     * so the time depends on the number of changes and not on the size of the tour
+     * Positions are computed on the first call (or by PreparePositions) and kept between calls,
+     * the tour stays in LocalSearch
+     * heavy_before and heavy_after are not counted and are -1
+     * @param vertexes - ends of changed edges
+     * @param max_evaluations - limit of vertexes taken from the work list, moves may be chained without end otherwise
+     * @param max_distance - moves are tried only between vertexes, which are not farther in the tour,
+     * so that a move reverses O(max_distance) vertexes instead of O(size of the tour)
+     * @return decrease of weight of the tour
+     */
+    long long ImproveAround(const vector<int> &vertexes, std::chrono::steady_clock::time_point deadline,
+                            long long max_evaluations = LLONG_MAX, int max_distance = INT_MAX) {
+        stats = Stats();
+        stats.heavy_before = stats.heavy_after = -1;
+        gain = 0;
+        this->max_evaluations = max_evaluations;
+        this->max_distance = max_distance;
+        PreparePositions();
+        for (int vertex: vertexes) {
+            Push(vertex);
+        }
+        RunWorkList(deadline);
+        return gain;
+    }
+
+    /**
+     * @return true if first_vertex and second_vertex are neighbours in the tour kept by ImproveAround
+     */
+    bool IsTourEdge(int first_vertex, int second_vertex) {
+        PreparePositions();
+        return Next(first_vertex) == second_vertex || Prev(first_vertex) == second_vertex;
+    }
+
+    /**
+     * Computes positions of vertexes for ImproveAround and IsTourEdge in O(n), if they are not computed yet,
+     * so that the cost is not paid by their first call
+     */
+    void PreparePositions() {
+        if (position.size() == static_cast<size_t>(graph.Size())) {
+            return;
+        }
+        position.resize(graph.Size());
+        in_work_list.assign(graph.Size(), false);
+        for (int i = 0; i < static_cast<int>(tour.size()); ++i) {
+            position[tour[i]] = i;
+        }
+    }
+
+    /**
+     * @return tour kept by ImproveAround
+     */
+    const vector<int> &GetTour() const {
+        return tour;
+    }
+
+    const Stats &GetStats() const {
+        return stats;
+    }
+
+private:
+    const static int MIN_TOUR_SIZE = 8;
+    const static int MAX_SEGMENT_LENGTH = 3;
+    const static int CHECK_PERIOD = 4096;
+
+    bool IsOver(std::chrono::steady_clock::time_point deadline) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            stats.timed_out = true;
+        }
+        return stats.timed_out;
+    }
+
+    /**
+     * Takes vertexes from the work list and applies improving moves until the list is empty or the deadline
+     */
+    void RunWorkList(std::chrono::steady_clock::time_point deadline) {
+        if (tour.size() < MIN_TOUR_SIZE) {
+            ClearWorkList();
+        }
+        while (!work_list.empty() && stats.evaluations < max_evaluations) {
+            if (IsOver(deadline)) {
+                break;
+            }
+            int vertex = work_list.back();
+            work_list.pop_back();
+            in_work_list[vertex] = false;
+            stats.evaluations++;
+            if (ImproveVertex(vertex)) {
+                // other heavy edge of the vertex may be removed too
+                Push(vertex);
+            }
+        }
+        ClearWorkList();
+    }
+
+    void ClearWorkList() {
+        for (int vertex: work_list) {
+            in_work_list[vertex] = false;
+        }
+        work_list.clear();
+    }
+
+    int Weight(int first_vertex, int second_vertex) const {
+        return graph.GetEdgeWeight(first_vertex, second_vertex);
+    }
+
+    int Next(int vertex) const {
+        int i = position[vertex] + 1;
+        return tour[i == static_cast<int>(tour.size()) ? 0 : i];
+    }
+
+    int Prev(int vertex) const {
+        int i = position[vertex];
+        return tour[i == 0 ? tour.size() - 1 : i - 1];
+    }
+
+    /**
+     * @return number of edges between vertexes in the tour, in the shorter direction
+     */
+    int Distance(int first_vertex, int second_vertex) const {
+        int distance = std::abs(position[first_vertex] - position[second_vertex]);
+        return std::min<int>(distance, tour.size() - distance);
+    }
+
+    /**
+     * @param forward - direction
+     * @return neighbour of vertex in the tour in direction
+     */
+    int Step(int vertex, bool forward) const {
+        return forward ? Next(vertex) : Prev(vertex);
+    }
+
+    void Push(int vertex) {
+        if (!in_work_list[vertex]) {
+            in_work_list[vertex] = true;
+            work_list.push_back(vertex);
+        }
+    }
+
+    /**
+     * Tries moves, which remove a heavy edge of vertex, applies the first improving one
+     * @return true if tour is changed
+     */
+    bool ImproveVertex(int vertex) {
+        for (bool forward: {true, false}) {
+            int neighbour = Step(vertex, forward);
+            if (Weight(vertex, neighbour) == LIGHT_EDGE) {
+                continue;
+            }
+            if (TryTwoOpt(vertex, neighbour, forward) || TryMoveSegmentOut(vertex, neighbour, forward) ||
+                TryMoveSegmentIn(vertex, neighbour)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Removes heavy edge (a, b) and edge (c, d) to light neighbour c of a, adds (a, c) and (b, d)
+     * b and d are on the same side (forward) of a and c
+     */
+    bool TryTwoOpt(int a, int b, bool forward) {
+        bool moved = false;
+        graph.ForEachLightNeighbour(a, [&](int c) {
+            if (moved || c == b) {
+                return;
+            }
+            int d = Step(c, forward);
+            if (d == a || Distance(a, c) > max_distance) {
+                return;
+            }
+            // removed: (a, b) - heavy, (c, d); added: (a, c) - light, (b, d)
+            int gain = HEAVY_EDGE + Weight(c, d) - LIGHT_EDGE - Weight(b, d);
+            if (gain > 0) {
+                this->gain += gain;
+                TwoOptMove(a, b, c, d);
+                stats.two_opt_moves++;
+                PushAll({a, b, c, d});
+                moved = true;
+            }
+        });
+        return moved;
+    }
+
+    /**
+     * Removes heavy edge (a, b) by moving segment, which starts at b and goes away from a,
+     * next to a light neighbour of one of its ends
+     */
+    bool TryMoveSegmentOut(int a, int b, bool forward) {
+        int end = b;
+        for (int length = 1; length <= MAX_SEGMENT_LENGTH; ++length, end = Step(end, forward)) {
+            int after = Step(end, forward);
+            if (after == a) {
+                break;
+            }
+            for (int segment_end: {b, end}) {
+                bool moved = false;
+                graph.ForEachLightNeighbour(segment_end, [&](int x) {
+                    for (bool side: {true, false}) {
+                        if (!moved && TryOrOpt(a, b, end, after, x, Step(x, side), length)) {
+                            moved = true;
+                        }
+                    }
+                });
+                if (moved) {
+                    return true;
+                }
+                if (length == 1) {
+                    // b == end
+                    break;
+                }
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Removes heavy edge (a, b) by inserting between a and b a segment, which starts at a light neighbour of a
+     */
+    bool TryMoveSegmentIn(int a, int b) {
+        bool moved = false;
+        graph.ForEachLightNeighbour(a, [&](int c) {
+            for (bool forward: {true, false}) {
+                int end = c;
+                for (int length = 1; !moved && length <= MAX_SEGMENT_LENGTH; ++length, end = Step(end, forward)) {
+                    moved = TryOrOpt(Step(c, !forward), c, end, Step(end, forward), a, b, length);
+                }
+            }
+        });
+        return moved;
+    }
+
+    /**
+     * Moves segment s1..s2 of length from between p and n to between x and y, if it decreases weight of the tour,
+     * inserts segment in that orientation, which is better
+     * p, s1, ..., s2, n and x, y are consecutive in the tour
+     * @return true if segment is moved
+     */
+    bool TryOrOpt(int p, int s1, int s2, int n, int x, int y, int length) {
+        if (p == n || x == p || x == n || y == p || y == n || Distance(p, x) > max_distance) {
+            return false;
+        }
+        for (int v = s1, i = 0; i < length; ++i, v = (Next(p) == s1 ? Next(v) : Prev(v))) {
+            if (v == x || v == y) {
+                return false;
+            }
+        }
+        int removed = Weight(p, s1) + Weight(s2, n) + Weight(x, y);
+        int same = Weight(x, s1) + Weight(s2, y);
+        int reversed = Weight(x, s2) + Weight(s1, y);
+        int gain = removed - Weight(p, n) - std::min(same, reversed);
+        if (gain <= 0) {
+            return false;
+        }
+        this->gain += gain;
+
+        // orient both edges forward: s1 = Next(p), y = Next(x)
+        if (Next(p) != s1) {
+            std::swap(p, n);
+            std::swap(s1, s2);
+            std::swap(same, reversed);
+        }
+        if (Next(x) != y) {
+            std::swap(x, y);
+            std::swap(same, reversed);
+        }
+        // p x ... n s2 ... s1 y
+        TwoOptMove(p, s1, x, y);
+        // p n ... x s2 ... s1 y
+        TwoOptMove(p, x, n, s2);
+        if (same < reversed) {
+            // p n ... x s1 ... s2 y
+            TwoOptMove(x, s2, s1, y);
+        }
+        stats.or_opt_moves++;
+        PushAll({p, n, x, y, s1, s2});
+        return true;
+    }
+
+    /**
+     * Removes edges (a, b) and (c, d) and adds (a, c) and (b, d)
+     * b is a neighbour of a and d is a neighbour of c in the same direction
+     */
+    void TwoOptMove(int a, int b, int c, [[maybe_unused]] int d) {
+        if (Next(a) == b) {
+            assert(Next(c) == d);
+            // a b ... c d -> a c ... b d
+            Reverse(b, c);
+        } else {
+            assert(Prev(a) == b && Prev(c) == d);
+            // d c ... b a -> d b ... c a
+            Reverse(c, b);
+        }
+    }
+
+    /**
+     * Reverses path from first to last in forward direction.
+     * If the path is longer than half of the tour, reverses the rest of the tour instead,
+     * which gives the same cycle walked in the other direction
+     */
+    void Reverse(int first, int last) {
+        int n = tour.size();
+        int i = position[first];
+        int j = position[last];
+        int length = (j - i + n) % n + 1;
+        if (2 * length > n) {
+            i = position[Next(last)];
+            j = position[Prev(first)];
+            length = n - length;
+        }
+        for (int k = 0; k < length / 2; ++k) {
+            std::swap(tour[i], tour[j]);
+            position[tour[i]] = i;
+            position[tour[j]] = j;
+            i = i + 1 == n ? 0 : i + 1;
+            j = j == 0 ? n - 1 : j - 1;
+        }
+    }
+
+    void PushAll(std::initializer_list<int> vertexes) {
+        for (int vertex: vertexes) {
+            Push(vertex);
+        }
+    }
+
+    const Graph &graph;
+    vector<int> tour;
+    vector<int> position; // index of vertex in tour
+    vector<char> in_work_list;
+    vector<int> work_list; // vertexes, which may have improving moves
+    long long gain = 0; // decrease of weight of the tour by applied moves
+    long long max_evaluations = LLONG_MAX;
+    int max_distance = INT_MAX; // moves between vertexes farther in the tour are not tried
+    Stats stats;
+};
+
+
+#endif //HELLOWORLD_LOCALSEARCH_H
@@ -0,0 +1,176 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_MATRIXFILE_H
+#define HELLOWORLD_MATRIXFILE_H
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Graph.h"
+#include "BitMatrix.h"
+
+using std::vector;
+using std::string;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "MatrixFile is stored in little-endian byte order");
+
+/**
+ * Binary file with a dense graph: matrix of light edges, one bit per pair of vertexes, for graphs beyond memory
+ *
+ * Layout, numbers are little-endian:
+ * Header, padded with zeros to DATA_OFFSET bytes (a multiple of the size of a page)
+ * uint64 words[num_vertexes][words_per_row] - rows of BitMatrix: bit j of row i is set if (i, j) is light
+ *
+ * Open maps the file private and writable: pages are read by the kernel on the first access, changes made
+ * by Graph::AddEdge stay in memory and never reach the file. The mapping is advised for random access,
+ * so a single weight costs a single page, and code, which reads the whole matrix, prefetches tiles of rows
+ * ahead (see BitMatrix::Prefetch, Graph::GetEdgeWeights and TSPApproximation::BuildBipartiteGraph).
+ */
+class MatrixFile {
+public:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t num_vertexes;
+        uint64_t words_per_row;
+        uint64_t data_offset;
+        uint64_t file_size;
+    };
+
+    constexpr static char MAGIC[8] = {'T', 'S', 'P', '1', '2', 'M', 'A', 'T'};
+    constexpr static uint32_t VERSION = 1;
+    constexpr static uint64_t DATA_OFFSET = 1 << 16;
+
+    /**
+     * Writes light edges of a graph in any storage row by row, memory is O(n)
+     * throws std::runtime_error if the file can't be written
+     */
+    static void Write(const string &path, const Graph &graph) {
+        int n = graph.Size();
+        uint64_t words_per_row = BitMatrix::WordsPerRow(n);
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.num_vertexes = n;
+        header.words_per_row = words_per_row;
+        header.data_offset = DATA_OFFSET;
+        header.file_size = FileSize(n);
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("can't open " + path + " for writing");
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        vector<char> padding(DATA_OFFSET - sizeof(header), 0);
+        out.write(padding.data(), padding.size());
+        vector<uint64_t> row(words_per_row);
+        for (int vertex = 0; vertex < n; ++vertex) {
+            std::fill(row.begin(), row.end(), 0);
+            graph.ForEachLightNeighbour(vertex, [&](int another_vertex) {
+                row[another_vertex >> 6] |= 1ULL << (another_vertex & 63);
+            });
+            out.write(reinterpret_cast<const char *>(row.data()), row.size() * sizeof(uint64_t));
+        }
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("can't write " + path);
+        }
+    }
+
+    /**
+     * Maps the file, checks header and size
+     * throws std::runtime_error if the file can't be mapped or is not a valid matrix
+     */
+    static MatrixFile Open(const string &path) {
+        MatrixFile file;
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor == -1) {
+            throw std::runtime_error("can't open " + path);
+        }
+        struct stat file_stat{};
+        if (fstat(descriptor, &file_stat) == -1 || file_stat.st_size < static_cast<off_t>(DATA_OFFSET)) {
+            close(descriptor);
+            throw std::runtime_error(path + " is not a matrix file");
+        }
+        file.size = file_stat.st_size;
+        file.data = mmap(nullptr, file.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+        close(descriptor);
+        if (file.data == MAP_FAILED) {
+            file.data = nullptr;
+            throw std::runtime_error("can't map " + path);
+        }
+
+        const auto &header = *static_cast<const Header *>(file.data);
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.num_vertexes >= INT_MAX || header.data_offset != DATA_OFFSET ||
+            header.words_per_row != BitMatrix::WordsPerRow(header.num_vertexes)) {
+            throw std::runtime_error(path + " is not a matrix file");
+        }
+        if (header.file_size != file.size || FileSize(header.num_vertexes) != file.size) {
+            throw std::runtime_error(path + " has wrong size");
+        }
+        file.num_vertexes = header.num_vertexes;
+        madvise(file.data, file.size, MADV_RANDOM);
+        return file;
+    }
+
+    MatrixFile(MatrixFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MatrixFile &operator=(MatrixFile &&other) noexcept {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        std::swap(num_vertexes, other.num_vertexes);
+        return *this;
+    }
+
+    MatrixFile(const MatrixFile &) = delete;
+
+    MatrixFile &operator=(const MatrixFile &) = delete;
+
+    ~MatrixFile() {
+        if (data != nullptr) {
+            munmap(data, size);
+        }
+    }
+
+    /**
+     * @return graph in dense storage on the mapped matrix, valid while the file is open
+     */
+    Graph GetGraph() const {
+        auto *words = reinterpret_cast<uint64_t *>(static_cast<char *>(data) + DATA_OFFSET);
+        return Graph::FromBitMatrix(BitMatrix::FromWords(num_vertexes, words));
+    }
+
+    int NumVertexes() const {
+        return num_vertexes;
+    }
+
+private:
+    MatrixFile() = default;
+
+    static uint64_t FileSize(uint64_t num_vertexes) {
+        return DATA_OFFSET + num_vertexes * BitMatrix::WordsPerRow(num_vertexes) * sizeof(uint64_t);
+    }
+
+    void *data = nullptr;
+    size_t size = 0;
+    int num_vertexes = 0;
+};
+
+
+#endif //HELLOWORLD_MATRIXFILE_H
@@ -0,0 +1,191 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_SOLVESTATS_H
+#define HELLOWORLD_SOLVESTATS_H
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <sys/resource.h>
+#include "AllocationCounter.h"
+#include "Arena.h"
+
+using std::vector;
+using std::pair;
+using std::string;
+
+/**
+ * Wall time, counters and memory of every phase of one solve
+ *
+ * Filled by TSPApproximation, if it is passed in ApproximationOptions,
+ * and exported as JSON or as Chrome trace events (chrome://tracing, Perfetto)
+ * Heap allocations are counted only if the program includes CountingNew.h, otherwise they are not exported
+ */
+class SolveStats {
+public:
+    struct PhaseStats {
+        string name;
+        double start_us; // from creation of SolveStats
+        double duration_us;
+        uint64_t allocations; // heap allocations, see AllocationCounter, 0 if it is not installed
+        uint64_t allocated_bytes;
+        uint64_t arena_allocations; // allocations of containers on the Arena of the solve
+        uint64_t arena_bytes;
+        long peak_rss_kb; // peak resident memory of the process at the end of phase
+        vector<pair<string, long long>> counters;
+    };
+
+    /**
+     * Measures phase from construction to destruction, does nothing if stats is nullptr
+     */
+    class Phase {
+    public:
+        /**
+         * @param name - not a string, so that nothing is allocated if stats is nullptr
+         * @param arena - arena of the solve, if containers of the phase are on it
+         */
+        Phase(SolveStats *stats, const char *name, const Arena *arena = nullptr) : stats(stats), arena(arena) {
+            if (stats != nullptr) {
+                index = stats->phases.size();
+                stats->phases.push_back({name, stats->Now(), 0, AllocationCounter::Allocations(),
+                                         AllocationCounter::AllocatedBytes(), ArenaAllocations(), ArenaBytes(),
+                                         0, {}});
+            }
+        }
+
+        Phase(const Phase &) = delete;
+
+        Phase &operator=(const Phase &) = delete;
+
+        ~Phase() {
+            if (stats != nullptr) {
+                auto &phase = stats->phases[index];
+                phase.duration_us = stats->Now() - phase.start_us;
+                phase.allocations = AllocationCounter::Allocations() - phase.allocations;
+                phase.allocated_bytes = AllocationCounter::AllocatedBytes() - phase.allocated_bytes;
+                phase.arena_allocations = ArenaAllocations() - phase.arena_allocations;
+                phase.arena_bytes = ArenaBytes() - phase.arena_bytes;
+                phase.peak_rss_kb = PeakResidentMemory();
+            }
+        }
+
+        void Count(const string &counter, long long value) {
+            if (stats != nullptr) {
+                stats->phases[index].counters.emplace_back(counter, value);
+            }
+        }
+
+    private:
+        uint64_t ArenaAllocations() const {
+            return arena != nullptr ? arena->Allocations() : 0;
+        }
+
+        uint64_t ArenaBytes() const {
+            return arena != nullptr ? arena->AllocatedBytes() : 0;
+        }
+
+        SolveStats *stats;
+        const Arena *arena;
+        size_t index = 0;
+    };
+
+    SolveStats() : start(std::chrono::steady_clock::now()) {}
+
+    const vector<PhaseStats> &GetPhases() const {
+        return phases;
+    }
+
+    /**
+     * @return {"total_us": ..., "peak_rss_kb": ..., "allocations": ..., "phases": [...]},
+     * without "allocations" and "allocated_bytes", if heap allocations are not counted (see AllocationCounter)
+     */
+    string ToJson() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        double total_us = 0;
+        uint64_t allocations = 0;
+        long peak_rss_kb = 0;
+        for (const auto &phase: phases) {
+            total_us += phase.duration_us;
+            allocations += phase.allocations;
+            peak_rss_kb = std::max(peak_rss_kb, phase.peak_rss_kb);
+        }
+        bool heap = AllocationCounter::IsInstalled();
+        out << "{\"total_us\": " << total_us << ", \"peak_rss_kb\": " << peak_rss_kb;
+        if (heap) {
+            out << ", \"allocations\": " << allocations;
+        }
+        out << ", \"phases\": [";
+        for (size_t i = 0; i < phases.size(); ++i) {
+            const auto &phase = phases[i];
+            out << (i == 0 ? "" : ", ") << "{\"name\": \"" << phase.name << "\", \"start_us\": " << phase.start_us
+                << ", \"duration_us\": " << phase.duration_us;
+            if (heap) {
+                out << ", \"allocations\": " << phase.allocations << ", \"allocated_bytes\": " << phase.allocated_bytes;
+            }
+            out << ", \"arena_allocations\": " << phase.arena_allocations << ", \"arena_bytes\": " << phase.arena_bytes
+                << ", \"peak_rss_kb\": " << phase.peak_rss_kb
+                << ", \"counters\": ";
+            WriteCounters(out, phase);
+            out << "}";
+        }
+        out << "]}";
+        return out.str();
+    }
+
+    /**
+     * @return trace in Chrome trace event format, every phase is a complete event
+     */
+    string ToChromeTrace() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        out << "{\"traceEvents\": [";
+        for (size_t i = 0; i < phases.size(); ++i) {
+            const auto &phase = phases[i];
+            out << (i == 0 ? "" : ", ") << "{\"name\": \"" << phase.name << "\", \"cat\": \"solve\", \"ph\": \"X\""
+                << ", \"ts\": " << phase.start_us << ", \"dur\": " << phase.duration_us
+                << ", \"pid\": 1, \"tid\": 1, \"args\": ";
+            WriteCounters(out, phase);
+            out << "}";
+        }
+        out << "], \"displayTimeUnit\": \"ms\"}";
+        return out.str();
+    }
+
+private:
+    double Now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @return peak resident memory of the process in kilobytes
+     */
+    static long PeakResidentMemory() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    static void WriteCounters(std::ostringstream &out, const PhaseStats &phase) {
+        out << "{";
+        for (size_t i = 0; i < phase.counters.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << "\"" << phase.counters[i].first << "\": " << phase.counters[i].second;
+        }
+        out << "}";
+    }
+
+    std::chrono::steady_clock::time_point start;
+    vector<PhaseStats> phases;
+};
+
+
+#endif //HELLOWORLD_SOLVESTATS_H
@@ -0,0 +1,73 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_SOLVER_H
+#define HELLOWORLD_SOLVER_H
+
+#pragma once
+
+#include <vector>
+#include "Graph.h"
+#include "Cycle.h"
+#include "TSPApproximation.h"
+
+using std::vector;
+
+/**
+ * Long-lived solver for many instances, one after another
+ *
+ * Keeps one BasicTSPApproximation of each index type with all its memory between solves: temporary arrays
+ * of phases, the arena of hash containers, the bipartite graph and the pool of threads. Each solve takes
+ * the approximation of the narrowest index type, which fits the graph (see DispatchIndex).
+ * The tour is written to a vector of the caller, so its memory is reused too.
+ * After a few solves of instances of similar size, Solve with given cycles makes no heap allocations,
+ * if options.starts is 1 and options.local_search_ms is 0 (multi-start and LocalSearch allocate their own state,
+ * as does CycleCover). This holds for any options.threads: the pool keeps its queues of tasks (see ThreadPool),
+ * and buffers and arenas of threads are sized for any chunk, whichever thread takes it.
+ */
+class Solver {
+public:
+    explicit Solver(const ApproximationOptions &options = ApproximationOptions()) : narrow(options), wide(options) {}
+
+    Solver(const Solver &) = delete;
+
+    Solver &operator=(const Solver &) = delete;
+
+    /**
+     * @param graph - used only during the call
+     * @param cycles - cycles which cover all vertexes of the graph
+     * @param tour - result
+     */
+    void Solve(const Graph &graph, const FlatCycles &cycles, vector<int> &tour) {
+        DispatchIndex(graph.Size(), [&](auto index) {
+            Approximation<decltype(index)>().Solve(graph, cycles, tour);
+        });
+    }
+
+    /**
+     * Experimental: same as above, but finds cycles which cover all vertexes of a graph by itself (see CycleCover),
+     * without the guarantee of 7/6
+     */
+    void Solve(const Graph &graph, vector<int> &tour) {
+        DispatchIndex(graph.Size(), [&](auto index) {
+            Approximation<decltype(index)>().Solve(graph, tour);
+        });
+    }
+
+private:
+    template<typename Index>
+    BasicTSPApproximation<Index> &Approximation() {
+        if constexpr (std::is_same<Index, NarrowIndex>::value) {
+            return narrow;
+        } else {
+            return wide;
+        }
+    }
+
+    BasicTSPApproximation<NarrowIndex> narrow; // for graphs of at most NARROW_INDEX_VERTEXES vertexes
+    BasicTSPApproximation<int> wide;
+};
+
+
+#endif //HELLOWORLD_SOLVER_H
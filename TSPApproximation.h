@@ -12,10 +12,23 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cassert>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <mutex>
 #include "BipartiteGraph.h"
+#include "CycleCover.h"
 #include "Cycle.h"
 #include "Graph.h"
 #include "DirectedGraph.h"
+#include "UnionFind.h"
+#include "SolveStats.h"
+#include "ThreadPool.h"
+#include "LocalSearch.h"
+#include "Arena.h"
+#include "TourEvaluator.h"
+#include "IndexArray.h"
 
 using std::vector;
 using std::pair;
@@ -24,85 +37,772 @@ using std::unordered_set;
 using std::cout;
 using std::endl;
 
-class TSPApproximation {
+/**
+ * Optional settings of TSPApproximation
+ */
+struct ApproximationOptions {
+    SolveStats *stats = nullptr; // if not nullptr, filled with time, counters and memory of every phase
+    int threads = 1; // threads for parallel phases, 0 - all hardware threads
+    double local_search_ms = 0; // time for improvement of the tour by LocalSearch, 0 - no improvement
+    // the time may be exceeded by one move, see LocalSearch::Improve
+    uint64_t seed = 0; // seed of random tie-breaking and order of cycles and edges, 0 - no randomisation
+    int starts = 1; // number of variants of the construction with seeds seed, seed + 1, ..., best tour is kept
+    // -1 - maximum matching of cycles, k >= 0 - greedy matching with k phases of augmentation, O(n + m) time,
+    // the tour may be heavier (see BipartiteGraph::FindGreedyMatching)
+    int matching_phases = -1;
+    // with matching_phases >= 0, also finds maximum matching to count cycles left unmatched by the greedy one
+    // (counter "unmatched_vs_optimum" of stats), matching takes as long as without the option then
+    bool compare_matching = false;
+};
+
+/**
+ * Papadimitriou-Yannakakis approximation of TSP with weights 1 and 2,
+ * within 7/6 of the optimum, if it is built from a minimum triangle-free cycle cover
+ * Index - type of vertexes and cycles in arrays of the construction (cycles, bipartite graph, matching,
+ * graph of cycles, sets of joined cycles), NarrowIndex for graphs of at most NARROW_INDEX_VERTEXES vertexes
+ * or int, see TSPApproximation, which picks it by the number of vertexes
+ */
+template<typename Index>
+class BasicTSPApproximation {
+    using BipartiteGraph = BasicBipartiteGraph<Index>;
+    using BipartiteEdge = typename BipartiteGraph::Edge;
+    using Cycle = BasicCycle<Index>;
+    using CycleLinks = BasicCycleLinks<Index>;
+    using DirectedGraph = BasicDirectedGraph<Index>;
+    using UnionFind = BasicUnionFind<Index>;
+
 public:
-    TSPApproximation(const vector<vector<int>> &edges, const vector<vector<int>> &cycles) : graph(
-            edges.size()) {
-        for (int i = 0; i < edges.size(); ++i) {
-            for (int j = i + 1; j < edges.size(); ++j) {
-                graph.AddEdge(i, j, edges[i][j]);
-            }
+    BasicTSPApproximation(const vector<vector<int>> &edges, const vector<vector<int>> &cycles,
+                     const ApproximationOptions &options = ApproximationOptions())
+            : options(options), owned_graph(BuildGraph(options, [&] { return Graph::FromMatrix(edges); })),
+              graph(&owned_graph), random(options.seed) {
+        Approximate(cycles);
+    }
+
+    /**
+     * Experimental: finds cycles which cover all vertexes of a graph by itself (see CycleCover)
+     * The cover is found by a heuristic, so the tour is not guaranteed to be within 7/6 of the optimum,
+     * as it is with a minimum triangle-free cover given by the caller
+     * @param edges - matrix of weights
+     */
+    explicit BasicTSPApproximation(const vector<vector<int>> &edges,
+                              const ApproximationOptions &options = ApproximationOptions())
+            : options(options), owned_graph(BuildGraph(options, [&] { return Graph::FromMatrix(edges); })),
+              graph(&owned_graph), random(options.seed) {
+        Approximate(FindCycleCover());
+    }
+
+    /**
+     * @param n - number of vertexes in a graph
+     * @param light_edges - edges of weight 1, all other edges have weight 2
+     * @param cycles - cycles which cover all vertexes of a graph
+     *
+     * Uses memory and time proportional to n plus number of light edges
+     */
+    BasicTSPApproximation(int n, const vector<pair<int, int>> &light_edges, const vector<vector<int>> &cycles,
+                     const ApproximationOptions &options = ApproximationOptions())
+            : options(options), owned_graph(BuildGraph(options, [&] { return Graph::FromLightEdges(n, light_edges); })),
+              graph(&owned_graph), random(options.seed) {
+        Approximate(cycles);
+    }
+
+    /**
+     * Experimental: same as above, but finds cycles which cover all vertexes of a graph by itself (see CycleCover),
+     * without the guarantee of 7/6
+     */
+    BasicTSPApproximation(int n, const vector<pair<int, int>> &light_edges,
+                     const ApproximationOptions &options = ApproximationOptions())
+            : options(options), owned_graph(BuildGraph(options, [&] { return Graph::FromLightEdges(n, light_edges); })),
+              graph(&owned_graph), random(options.seed) {
+        Approximate(FindCycleCover());
+    }
+
+    /**
+     * Works on a graph and cycles owned by the caller (e.g. mapped by InstanceFile), without copying them
+     * @param graph - must outlive the approximation
+     */
+    BasicTSPApproximation(const Graph &graph, const FlatCycles &cycles,
+                     const ApproximationOptions &options = ApproximationOptions())
+            : options(options), owned_graph(0), graph(&graph), random(options.seed) {
+        Approximate(cycles);
+    }
+
+    /**
+     * Experimental: same as above, but finds cycles which cover all vertexes of a graph by itself (see CycleCover),
+     * without the guarantee of 7/6
+     */
+    BasicTSPApproximation(const Graph &graph, const ApproximationOptions &options)
+            : options(options), owned_graph(0), graph(&graph), random(options.seed) {
+        Approximate(FindCycleCover());
+    }
+
+    BasicTSPApproximation(const BasicTSPApproximation &) = delete;
+
+    BasicTSPApproximation &operator=(const BasicTSPApproximation &) = delete;
+
+    vector<int> GetApproximation() {
+        return approximation;
+    }
+
+private:
+    template<typename> friend class PhaseBenchmark;
+    friend class Solver;
+
+    const static int CHUNKS_PER_THREAD = 4;
+
+    using CycleSet = std::pmr::unordered_set<int>; // indexes of cycles, on the arena
+
+    struct SplitLog;
+    struct SplitWorker;
+
+    /**
+     * Creates approximation without running any phase, phases are called by PhaseBenchmark
+     */
+    explicit BasicTSPApproximation(Graph graph) : owned_graph(std::move(graph)), graph(&owned_graph) {}
+
+    /**
+     * Creates approximation without a graph, graphs are given to Solve by Solver
+     */
+    explicit BasicTSPApproximation(const ApproximationOptions &options)
+            : options(options), owned_graph(0), graph(&owned_graph), random(options.seed) {}
+
+    /**
+     * Builds tour of graph from cycles, reusing memory of previous calls
+     * @param tour - result, its memory is reused too
+     */
+    void Solve(const Graph &graph, const FlatCycles &cycles, vector<int> &tour) {
+        this->graph = &graph;
+        random.seed(options.seed);
+        approximation.swap(tour);
+        Approximate(cycles);
+        approximation.swap(tour);
+    }
+
+    /**
+     * Experimental: same as above, but finds cycles which cover all vertexes of a graph by itself (see CycleCover),
+     * without the guarantee of 7/6
+     */
+    void Solve(const Graph &graph, vector<int> &tour) {
+        this->graph = &graph;
+        random.seed(options.seed);
+        approximation.swap(tour);
+        Approximate(FindCycleCover());
+        approximation.swap(tour);
+    }
+
+    template<typename Build>
+    static Graph BuildGraph(const ApproximationOptions &options, Build build) {
+        SolveStats::Phase phase(options.stats, "build graph");
+        auto graph = build();
+        phase.Count("vertexes", graph.Size());
+        phase.Count("index_bytes", graph.IndexBytes());
+        return graph;
+    }
+
+    vector<vector<int>> FindCycleCover() {
+        SolveStats::Phase phase(options.stats, "find cycle cover", &arena);
+        auto cycles = CycleCover(*graph).FindCycles();
+        phase.Count("cycles", cycles.size());
+        return cycles;
+    }
+
+    void Approximate(const vector<vector<int>> &cycles) {
+        vector<int> offsets;
+        vector<int> vertexes;
+        Approximate(Flatten(cycles, offsets, vertexes));
+    }
+
+    void Approximate(const FlatCycles &cycles) {
+        if (options.starts > 1) {
+            ApproximateMultiStart(cycles);
+        } else {
+            Construct(cycles);
         }
+        if (options.local_search_ms > 0) {
+            ImproveApproximation();
+        }
+    }
+
+    /**
+     * Runs options.starts variants of the construction with seeds options.seed, options.seed + 1, ...
+     * on options.threads threads, all of them share the graph-> Keeps the tour of the least weight,
+     * of tours of equal weight - the one with the least seed, so the result doesn't depend on threads.
+     * Variant with seed 0 is not randomised, so by default multi-start is never worse than one start.
+     */
+    void ApproximateMultiStart(const FlatCycles &cycles) {
+        SolveStats::Phase phase(options.stats, "multi-start", &arena);
+        std::mutex best_mutex;
+        int best_start = -1;
+        long long best_weight = 0;
+        long long worst_weight = 0;
+        RunParallel(options.starts, [&](int start, int) {
+            auto variant_options = options;
+            variant_options.stats = nullptr;
+            variant_options.threads = 1;
+            variant_options.local_search_ms = 0;
+            variant_options.starts = 1;
+            variant_options.seed = options.seed + start;
+            BasicTSPApproximation variant(*graph, cycles, variant_options);
+            long long weight = TourWeight(variant.approximation);
+
+            std::lock_guard<std::mutex> lock(best_mutex);
+            worst_weight = std::max(worst_weight, weight);
+            if (best_start == -1 || weight < best_weight || (weight == best_weight && start < best_start)) {
+                best_start = start;
+                best_weight = weight;
+                approximation = std::move(variant.approximation);
+            }
+        });
+        phase.Count("starts", options.starts);
+        phase.Count("best_start", best_start);
+        phase.Count("best_weight", best_weight);
+        phase.Count("worst_weight", worst_weight);
+    }
+
+    long long TourWeight(const vector<int> &tour) const {
+        auto evaluation = TourEvaluator().Evaluate(*graph, tour);
+        assert(evaluation.valid);
+        return evaluation.weight;
+    }
+
+    /**
+     * Papadimitriou-Yannakakis construction of a tour from cycles
+     */
+    void Construct(const FlatCycles &cycles) {
+        AddCycles(cycles);
+        JoinBadCycles();
+        int bad_cycle_idx = JoinGoodCyclesConnectedWithBadCycle();
+        MatchCycles(BuildBipartiteGraph(bad_cycle_idx));
+        SplitDirectedGraph();
+        JoinRemainingCycles(approximation);
+    }
+
+    /**
+     * Removes heavy edges from approximation by local search in options.local_search_ms milliseconds
+     */
+    void ImproveApproximation() {
+        SolveStats::Phase phase(options.stats, "local search", &arena);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::duration<double, std::milli>(options.local_search_ms));
+        LocalSearch local_search(*graph, std::move(approximation));
+        approximation = local_search.Improve(deadline);
+        const auto &local_search_stats = local_search.GetStats();
+        phase.Count("heavy_before", local_search_stats.heavy_before);
+        phase.Count("heavy_after", local_search_stats.heavy_after);
+        phase.Count("two_opt_moves", local_search_stats.two_opt_moves);
+        phase.Count("or_opt_moves", local_search_stats.or_opt_moves);
+        phase.Count("evaluations", local_search_stats.evaluations);
+        phase.Count("timed_out", local_search_stats.timed_out);
+    }
+
+    /**
+     * Copies cycles into flat arrays offsets and vertexes
+     * @return view of the arrays
+     */
+    static FlatCycles Flatten(const vector<vector<int>> &cycles, vector<int> &offsets, vector<int> &vertexes) {
+        offsets.assign(1, 0);
+        vertexes.clear();
         for (const auto &cycle: cycles) {
-            AddCycle(cycle);
+            vertexes.insert(vertexes.end(), cycle.begin(), cycle.end());
+            offsets.push_back(vertexes.size());
         }
+        return {static_cast<int>(cycles.size()), offsets.data(), vertexes.data()};
+    }
+
+    void AddCycles(const vector<vector<int>> &cycles) {
+        vector<int> offsets;
+        vector<int> vertexes;
+        AddCycles(Flatten(cycles, offsets, vertexes));
+    }
+
+    /**
+     * Starts a new construction: state of the previous one is dropped, but its memory is reused
+     */
+    void AddCycles(const FlatCycles &cycles) {
+        SolveStats::Phase phase(options.stats, "add cycles", &arena);
+        this->cycles = std::pmr::unordered_map<int, Cycle>(&arena);
+        bad_cycles = CycleSet(&arena);
+        arena.Reset();
+        this->cycles.reserve(cycles.num_cycles);
+        links.Reset(graph->Size());
+        vertexes.assign(graph->Size(), -1);
+        cycle_sets.Reset(cycles.num_cycles);
+        directed_graph.Clear();
+        if (graph->IsMapped()) {
+            FindCycleWeights(cycles);
+        }
+        if (options.seed == 0) {
+            for (int i = 0; i < cycles.num_cycles; ++i) {
+                AddCycle(cycles.Begin(i), cycles.Size(i));
+            }
+        } else {
+            // random order of cycles, random first vertex and direction of every cycle
+            auto &order = buffers.cycle_order;
+            order.resize(cycles.num_cycles);
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), random);
+            auto &cycle = buffers.cycle;
+            for (int i: order) {
+                cycle.assign(cycles.Begin(i), cycles.Begin(i) + cycles.Size(i));
+                std::rotate(cycle.begin(), cycle.begin() + random() % cycle.size(), cycle.end());
+                if (random() % 2 == 0) {
+                    std::reverse(cycle.begin(), cycle.end());
+                }
+                AddCycle(cycle.data(), cycle.size());
+            }
+        }
+        phase.Count("cycles", cycles.num_cycles);
+        phase.Count("bad_cycles", bad_cycles.size());
+        phase.Count("index_bytes", sizeof(Index));
+    }
 
-        // join all bad cycles in one
-        // after it graph has no more than one bad cycle
-        while (bad_cycles.size() > 1) {
-            auto it = bad_cycles.begin();
-            int c1 = *it;
-            it++;
-            int c2 = *it;
-            JoinTwoCycles(c1, c2);
+    /**
+     * Reads weights of all edges of cycles of a mapped graph at once in order of rows (see Graph::GetEdgeWeights),
+     * AddCycle takes them from buffers.next_weight instead of reading a page of the matrix for every edge
+     */
+    void FindCycleWeights(const FlatCycles &cycles) {
+        int n = graph->Size();
+        auto &next = buffers.next_vertex;
+        next.resize(n);
+        for (int i = 0; i < cycles.num_cycles; ++i) {
+            const int *cycle = cycles.Begin(i);
+            int size = cycles.Size(i);
+            for (int j = 0; j < size; ++j) {
+                next[cycle[j]] = cycle[j + 1 == size ? 0 : j + 1];
+            }
+        }
+        // edge i goes from cycles.vertexes[i] to its next vertex
+        auto &edge_end = buffers.edge_end;
+        edge_end.resize(n);
+        for (int i = 0; i < n; ++i) {
+            edge_end[i] = next[cycles.vertexes[i]];
+        }
+        auto &edge_weight = buffers.edge_weight;
+        edge_weight.resize(n);
+        graph->GetEdgeWeights(cycles.vertexes, edge_end.data(), n, edge_weight.data());
+        auto &next_weight = buffers.next_weight;
+        next_weight.resize(n);
+        for (int i = 0; i < n; ++i) {
+            next_weight[cycles.vertexes[i]] = edge_weight[i];
         }
+    }
 
+    /**
+     * Joins all bad cycles in one
+     * after it graph has no more than one bad cycle
+     */
+    void JoinBadCycles() {
+        SolveStats::Phase phase(options.stats, "join bad cycles", &arena);
+        phase.Count("joined", bad_cycles.empty() ? 0 : bad_cycles.size() - 1);
+        if (bad_cycles.size() > 1) {
+            auto &bad_cycles_to_join = buffers.cycles_to_join;
+            bad_cycles_to_join.assign(bad_cycles.begin(), bad_cycles.end());
+            if (options.seed != 0) {
+                std::shuffle(bad_cycles_to_join.begin(), bad_cycles_to_join.end(), random);
+            }
+            JoinAll(bad_cycles_to_join[0], bad_cycles_to_join);
+        }
+    }
 
-        // find all edges that goes from good cycle to bad cycle
-        // and has weight 1, connected with bad edge in bad cycle
+    /**
+     * Finds all edges that goes from good cycle to bad cycle
+     * and has weight 1, connected with bad edge in bad cycle, and joins such good cycles with bad cycle
+     * @return index of bad cycle or -1 if there is no bad cycle
+     */
+    int JoinGoodCyclesConnectedWithBadCycle() {
+        SolveStats::Phase phase(options.stats, "join good cycles with bad cycle", &arena);
         int bad_cycle_idx = -1;
-        unordered_set<int> good_connected_cycles;
+        CycleSet good_connected_cycles(&arena);
         if (bad_cycles.size() == 1) {
             bad_cycle_idx = *bad_cycles.begin();
             auto &c = this->cycles.at(bad_cycle_idx);
-            for (const auto &vertex: c.GetHeavyEdges()) {
-                for (auto another_vertex: graph.EdgesByVertex(vertex))
-                    if (another_vertex.second == 1) {
-                        int another_cycle_idx = GetCycle(another_vertex.first);
-                        auto &another_cycle = this->cycles.at(another_cycle_idx);
-                        if (another_cycle.IsGood() &&
-                            (good_connected_cycles.find(another_cycle_idx) == good_connected_cycles.end())) {
-                            good_connected_cycles.emplace(another_cycle_idx);
-                        }
+            auto connect = [&](int vertex) {
+                graph->ForEachLightNeighbour(vertex, [&](int another_vertex) {
+                    int another_cycle_idx = GetCycle(another_vertex);
+                    auto &another_cycle = this->cycles.at(another_cycle_idx);
+                    if (another_cycle.IsGood() &&
+                        (good_connected_cycles.find(another_cycle_idx) == good_connected_cycles.end())) {
+                        good_connected_cycles.emplace(another_cycle_idx);
+                    }
+                });
+            };
+            if (graph->IsMapped()) {
+                // rows in order, the next one is prefetched while the current one is read
+                auto &rows = buffers.rows;
+                rows.clear();
+                c.ForEachHeavyEdge([&](int vertex) {
+                    rows.push_back(vertex);
+                });
+                std::sort(rows.begin(), rows.end());
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    if (i + 1 < rows.size()) {
+                        graph->GetLightEdges().Prefetch(rows[i + 1], rows[i + 1] + 1);
                     }
+                    connect(rows[i]);
+                }
+            } else {
+                c.ForEachHeavyEdge(connect);
             }
 
-            // join all such good cycles with bad cycle
-            for (auto good_cycle_idx: good_connected_cycles) {
+            // join all such good cycles with bad cycle, in order of indexes, as the order of the set depends
+            // on the order of insertion, which is different for a mapped graph
+            auto &good_cycles_to_join = buffers.cycles_to_join;
+            good_cycles_to_join.assign(good_connected_cycles.begin(), good_connected_cycles.end());
+            std::sort(good_cycles_to_join.begin(), good_cycles_to_join.end());
+            for (auto good_cycle_idx: good_cycles_to_join) {
                 JoinTwoCycles(bad_cycle_idx, good_cycle_idx);
             }
         }
+        phase.Count("joined", good_connected_cycles.size());
+        return bad_cycle_idx;
+    }
+
+    /**
+     * Creates bipartite graph
+     * first part - good cycles
+     * second part - all vertexes
+     * cycle is connected with every vertex out of it, which has a light edge to some vertex of the cycle
+     *
+     * Cycles are split on chunks of about the same number of vertexes, chunks are processed
+     * by options.threads threads, each in its own buffer, and then copied in one compressed sparse rows
+     * (rows of a mapped graph are read in order instead, see FindCandidatesByRows)
+     */
+    BipartiteGraph &BuildBipartiteGraph(int bad_cycle_idx) {
+        SolveStats::Phase phase(options.stats, "build bipartite graph", &arena);
+        auto &good_cycles = buffers.good_cycles;
+        good_cycles.clear();
+        good_cycles.reserve(cycles.size());
+        long long good_vertexes = 0;
+        for (const auto &cycle: cycles) {
+            if (cycle.first != bad_cycle_idx) {
+                good_cycles.push_back(cycle.first);
+                good_vertexes += cycle.second.Size();
+            }
+        }
+        std::sort(good_cycles.begin(), good_cycles.end());
+        int first_part_size = good_cycles.empty() ? 0 : good_cycles.back() + 1;
+        auto &offsets = buffers.offsets;
+        auto &adjacency = buffers.adjacency;
+        int num_chunks = graph->IsMapped() ? FindCandidatesByRows(bad_cycle_idx, first_part_size)
+                                           : FindCandidatesByCycles(good_vertexes, first_part_size);
+
+        if (options.seed != 0) {
+            // random order of edges of every cycle for matching
+            for (int cycle_idx = 0; cycle_idx < first_part_size; ++cycle_idx) {
+                std::shuffle(adjacency.begin() + offsets[cycle_idx], adjacency.begin() + offsets[cycle_idx + 1], random);
+            }
+        }
+        phase.Count("edges", adjacency.size());
+        phase.Count("chunks", num_chunks);
+        // offsets and adjacency get arrays of the previous graph, to be reused by the next construction
+        bipartite_graph.Assign(first_part_size, graph->Size(), offsets, adjacency);
+        return bipartite_graph;
+    }
+
+    /**
+     * Fills buffers.offsets and buffers.adjacency by FindCandidates for every good cycle
+     * @return number of chunks
+     */
+    int FindCandidatesByCycles(long long good_vertexes, int first_part_size) {
+        const auto &good_cycles = buffers.good_cycles;
+        // chunk i - good cycles [chunk_begin[i], chunk_begin[i + 1])
+        int num_chunks = std::min<int>(good_cycles.size(), Threads() * CHUNKS_PER_THREAD);
+        auto &chunk_begin = buffers.chunk_begin;
+        chunk_begin.assign(1, 0);
+        long long vertexes_in_chunks = 0;
+        for (size_t i = 0; i < good_cycles.size(); ++i) {
+            vertexes_in_chunks += cycles.at(good_cycles[i]).Size();
+            if (vertexes_in_chunks * num_chunks >= good_vertexes * static_cast<long long>(chunk_begin.size())) {
+                chunk_begin.push_back(i + 1);
+            }
+        }
+        if (chunk_begin.back() != static_cast<int>(good_cycles.size())) {
+            chunk_begin.push_back(good_cycles.size());
+        }
+        num_chunks = chunk_begin.size() - 1;
+
+        auto &chunk_edges = buffers.chunk_edges;
+        chunk_edges.resize(num_chunks);
+        auto &offsets = buffers.offsets;
+        offsets.assign(first_part_size + 1, 0);
+        auto &candidates = buffers.candidates;
+        candidates.resize(Threads());
+        for (auto &buffer: candidates) {
+            // stamps of the previous construction are not valid, memory is taken for any thread at once,
+            // as chunks go to threads in any order
+            buffer.stamp.clear();
+            if (graph->IsDense()) {
+                buffer.row.reserve(graph->GetLightEdges().WordsPerRow());
+            } else {
+                buffer.stamp.reserve(graph->Size());
+            }
+        }
+        RunParallel(num_chunks, [&](int chunk, int thread) {
+            for (int i = chunk_begin[chunk]; i < chunk_begin[chunk + 1]; ++i) {
+                size_t size = chunk_edges[chunk].size();
+                FindCandidates(good_cycles[i], candidates[thread], chunk_edges[chunk]);
+                // different cycles of different chunks, so no two threads write the same element
+                offsets[good_cycles[i] + 1] = chunk_edges[chunk].size() - size;
+            }
+        });
+        for (int cycle_idx = 0; cycle_idx < first_part_size; ++cycle_idx) {
+            offsets[cycle_idx + 1] += offsets[cycle_idx];
+        }
+        auto &adjacency = buffers.adjacency;
+        adjacency.resize(offsets[first_part_size]);
+        RunParallel(num_chunks, [&](int chunk, int) {
+            if (!chunk_edges[chunk].empty()) {
+                std::copy(chunk_edges[chunk].begin(), chunk_edges[chunk].end(),
+                          adjacency.begin() + offsets[good_cycles[chunk_begin[chunk]]]);
+            }
+            chunk_edges[chunk].clear();
+        });
+        return num_chunks;
+    }
+
+    /**
+     * Fills buffers.offsets and buffers.adjacency with the same edges as FindCandidatesByCycles for a mapped graph,
+     * reading rows of vertexes of good cycles once and in order: every light neighbour u of vertex v out of
+     * the cycle of v is a candidate of the cycle. Then edges of every cycle are sorted by u and repeated candidates
+     * are removed, so edges of a cycle come in increasing order of u, as in FindCandidates, and v is kept
+     * as the vertex of the cycle, so MatchCycles doesn't read rows either.
+     * Rows are split on chunks of whole tiles (see BitMatrix::TileRows), a thread prefetches the next tile
+     * of its chunk while it reads the current one
+     * @return number of chunks
+     */
+    int FindCandidatesByRows(int bad_cycle_idx, int first_part_size) {
+        int n = graph->Size();
+        const auto &light_edges = graph->GetLightEdges();
+        auto &cycle_of = buffers.cycle_of;
+        cycle_of.resize(n);
+        for (int vertex = 0; vertex < n; ++vertex) {
+            // GetCycle compresses paths of cycle_sets, so it is called by one thread
+            cycle_of[vertex] = GetCycle(vertex);
+        }
+
+        int tile_rows = light_edges.TileRows();
+        int num_tiles = (n + tile_rows - 1) / tile_rows;
+        int num_chunks = std::max(1, std::min(num_tiles, Threads() * CHUNKS_PER_THREAD));
+        auto &chunk_edges = buffers.chunk_edges;
+        chunk_edges.resize(num_chunks);
+        auto &chunk_cycles = buffers.chunk_cycles;
+        chunk_cycles.resize(num_chunks);
+        RunParallel(num_chunks, [&](int chunk, int) {
+            int end_tile = static_cast<long long>(chunk + 1) * num_tiles / num_chunks;
+            for (int tile = static_cast<long long>(chunk) * num_tiles / num_chunks; tile < end_tile; ++tile) {
+                if (tile + 1 < end_tile) {
+                    light_edges.Prefetch((tile + 1) * tile_rows, (tile + 2) * tile_rows);
+                }
+                for (int vertex = tile * tile_rows; vertex < std::min(n, (tile + 1) * tile_rows); ++vertex) {
+                    int cycle_idx = cycle_of[vertex];
+                    if (cycle_idx == bad_cycle_idx) {
+                        continue;
+                    }
+                    light_edges.ForEachInRow(vertex, [&](int another_vertex) {
+                        if (cycle_of[another_vertex] != cycle_idx) {
+                            chunk_edges[chunk].push_back({another_vertex, vertex});
+                            chunk_cycles[chunk].push_back(cycle_idx);
+                        }
+                    });
+                }
+            }
+        });
+
+        // counting sort of edges of all chunks by cycles
+        auto &offsets = buffers.offsets;
+        offsets.assign(first_part_size + 1, 0);
+        for (const auto &cycles_of_edges: chunk_cycles) {
+            for (int cycle_idx: cycles_of_edges) {
+                offsets[cycle_idx + 1]++;
+            }
+        }
+        for (int cycle_idx = 0; cycle_idx < first_part_size; ++cycle_idx) {
+            offsets[cycle_idx + 1] += offsets[cycle_idx];
+        }
+        auto &adjacency = buffers.adjacency;
+        adjacency.resize(offsets[first_part_size]);
+        auto &position = buffers.rows;
+        position.assign(offsets.begin(), offsets.end() - 1);
+        for (int chunk = 0; chunk < num_chunks; ++chunk) {
+            for (size_t i = 0; i < chunk_edges[chunk].size(); ++i) {
+                adjacency[position[chunk_cycles[chunk][i]]++] = chunk_edges[chunk][i];
+            }
+            chunk_edges[chunk].clear();
+            chunk_cycles[chunk].clear();
+        }
+
+        // candidates of a cycle, sorted and without repeats, are moved to the left of its range
+        auto &size = buffers.rows;
+        RunParallel(num_chunks, [&](int chunk, int) {
+            for (int cycle_idx = static_cast<long long>(chunk) * first_part_size / num_chunks;
+                 cycle_idx < static_cast<long long>(chunk + 1) * first_part_size / num_chunks; ++cycle_idx) {
+                auto begin = adjacency.begin() + offsets[cycle_idx];
+                auto end = adjacency.begin() + offsets[cycle_idx + 1];
+                // stable, so the first vertex of the cycle in order of rows, the smallest one, is kept
+                std::stable_sort(begin, end, [](const BipartiteEdge &first, const BipartiteEdge &second) {
+                    return first.second_vertex < second.second_vertex;
+                });
+                size[cycle_idx] = std::unique(begin, end, [](const BipartiteEdge &first,
+                                                              const BipartiteEdge &second) {
+                    return first.second_vertex == second.second_vertex;
+                }) - begin;
+            }
+        });
+        int edges = 0;
+        for (int cycle_idx = 0; cycle_idx < first_part_size; ++cycle_idx) {
+            std::copy(adjacency.begin() + offsets[cycle_idx], adjacency.begin() + offsets[cycle_idx] + size[cycle_idx],
+                      adjacency.begin() + edges);
+            offsets[cycle_idx] = edges;
+            edges += size[cycle_idx];
+        }
+        offsets[first_part_size] = edges;
+        adjacency.resize(edges);
+        return num_chunks;
+    }
+
+    /**
+     * Memory of one thread for FindCandidates
+     */
+    struct CandidatesBuffer {
+        vector<uint64_t> row; // dense graph: union of light rows of vertexes of a cycle
+        vector<int> stamp; // sparse graph: index of the last cycle, which saw the vertex
+    };
 
-        // creating bipartite graph
-        // first part - good cycles
-        // second part - all vertexes
-        BipartiteGraph bipartite_graph;
-        for (const auto &vertex_edges: graph.GetEdges()) {
-            for (const auto &edge: vertex_edges.second) {
-                if (edge.second == 1 && (GetCycle(vertex_edges.first) != GetCycle(edge.first))
-                    && (GetCycle(vertex_edges.first) != bad_cycle_idx)) {
-                    // info: vertex_edges.first - index of a vertex in a cycle
-                    bipartite_graph.AddEdge(GetCycle(vertex_edges.first), edge.first, vertex_edges.first);
+    /**
+     * Appends to edges all vertexes out of the cycle connected with it by a light edge, each vertex once
+     *
+     * Dense graph: rows of light edges of all vertexes of the cycle are OR-ed word by word and vertexes
+     * of the cycle are masked out, the vertex of the cycle is not known then and is left -1 (see MatchCycles).
+     * Sparse graph: vertexes are deduplicated by stamps, vertexes of the cycle are stamped first.
+     */
+    void FindCandidates(int cycle_idx, CandidatesBuffer &buffer, vector<BipartiteEdge> &edges) const {
+        const auto &cycle = cycles.at(cycle_idx);
+        if (graph->IsDense()) {
+            const auto &light_edges = graph->GetLightEdges();
+            size_t words_per_row = light_edges.WordsPerRow();
+            buffer.row.assign(words_per_row, 0);
+            cycle.ForEachVertex([&](int vertex) {
+                const uint64_t *row = light_edges.Row(vertex);
+                for (size_t i = 0; i < words_per_row; ++i) {
+                    buffer.row[i] |= row[i];
+                }
+            });
+            cycle.ForEachVertex([&](int vertex) {
+                buffer.row[vertex >> 6] &= ~(1ULL << (vertex & 63));
+            });
+            for (size_t i = 0; i < words_per_row; ++i) {
+                for (uint64_t word = buffer.row[i]; word != 0; word &= word - 1) {
+                    edges.push_back({static_cast<int>(i * 64 + __builtin_ctzll(word)), -1});
                 }
             }
+            return;
+        }
+
+        if (buffer.stamp.empty()) {
+            buffer.stamp.assign(graph->Size(), -1);
+        }
+        cycle.ForEachVertex([&](int vertex) {
+            buffer.stamp[vertex] = cycle_idx;
+        });
+        cycle.ForEachVertex([&](int vertex) {
+            graph->ForEachLightNeighbour(vertex, [&](int another_vertex) {
+                if (buffer.stamp[another_vertex] != cycle_idx) {
+                    buffer.stamp[another_vertex] = cycle_idx;
+                    edges.push_back({another_vertex, vertex});
+                }
+            });
+        });
+    }
+
+    /**
+     * @return the smallest vertex of the cycle connected with vertex by a light edge, the same vertex
+     * as FindCandidatesByRows keeps, so tours of a matrix in memory and of a mapped one are the same
+     */
+    int FindLightNeighbourInCycle(int cycle_idx, int vertex) const {
+        int result = -1;
+        cycles.at(cycle_idx).ForEachVertex([&](int cycle_vertex) {
+            if ((result == -1 || cycle_vertex < result) && graph->GetEdgeWeight(cycle_vertex, vertex) == LIGHT_EDGE) {
+                result = cycle_vertex;
+            }
+        });
+        assert(result != -1);
+        return result;
+    }
+
+    int Threads() const {
+        return options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /**
+     * Calls task(i, thread) for every i in [0, num_tasks), on a pool of Threads() threads if there are more than one
+     * thread - index of the running thread in [0, Threads()), for buffers of threads
+     */
+    template<typename Task>
+    void RunParallel(int num_tasks, Task task) {
+        if (Threads() == 1 || num_tasks <= 1) {
+            for (int i = 0; i < num_tasks; ++i) {
+                task(i, 0);
+            }
+            return;
+        }
+        if (pool == nullptr) {
+            pool = std::make_unique<ThreadPool>(Threads());
         }
+        for (int i = 0; i < num_tasks; ++i) {
+            pool->Submit([&task, i] { task(i, ThreadPool::CurrentWorker()); });
+        }
+        pool->Wait();
+    }
 
-        // find optimal matching in a bipartite graph
-        auto matching = bipartite_graph.FindOptimalMatching();
+    /**
+     * Finds optimal (or greedy, see options.matching_phases) matching in a bipartite graph
+     * and creates directed graph of cycles by it
+     */
+    void MatchCycles(BipartiteGraph &bipartite_graph) {
+        SolveStats::Phase phase(options.stats, "matching", &arena);
+        auto &matching = buffers.matching;
+        if (options.matching_phases < 0) {
+            bipartite_graph.FindOptimalMatching(matching);
+        } else {
+            if (options.compare_matching) {
+                bipartite_graph.FindOptimalMatching(matching);
+                long long optimum = matching.size();
+                bipartite_graph.FindGreedyMatching(matching, options.matching_phases);
+                phase.Count("unmatched_vs_optimum", optimum - static_cast<long long>(matching.size()));
+            } else {
+                bipartite_graph.FindGreedyMatching(matching, options.matching_phases);
+            }
+        }
+        const auto &matching_stats = bipartite_graph.GetStats();
+        phase.Count("matched", matching.size());
+        phase.Count("initial_matched", matching_stats.initial_matched);
+        phase.Count("reductions", matching_stats.reductions);
+        phase.Count("phases", matching_stats.phases);
+        phase.Count("augmentations", matching_stats.augmentations);
+        phase.Count("dfs_visits", matching_stats.visits);
         for (auto edge: matching) {
             // edge.second.first - index of a cycle
             // edge.second.second - info: index of a vertex in a cycle
             // edge.first - index of a vertex not in a cycle
-            this->cycles.at(edge.second.first).SetConnectedEdge(std::make_pair(edge.second.second, edge.first));
+            int cycle_vertex = edge.second.second;
+            if (cycle_vertex == -1) {
+                cycle_vertex = FindLightNeighbourInCycle(edge.second.first, edge.first);
+            }
+            this->cycles.at(edge.second.first).SetConnectedEdge(std::make_pair(cycle_vertex, edge.first));
 
             // Creating directed graph of cycles
             // add inverse edges, not as in text
             directed_graph.AddEdge(GetCycle(edge.first), edge.second.first);
         }
+    }
 
-        SplitDirectedGraph();
-
-
+    /**
+     * Joins all remaining cycles to the bad cycle (or any cycle, if there is no bad cycle)
+     * @param tour - the only cycle left, memory of tour is reused
+     */
+    void JoinRemainingCycles(vector<int> &tour) {
+        SolveStats::Phase phase(options.stats, "join remaining cycles", &arena);
+        phase.Count("joined", this->cycles.size() - 1);
         int bad = -1;
         if (!bad_cycles.empty()) {
             bad = *bad_cycles.begin();
@@ -110,63 +810,140 @@ public:
             bad = this->cycles.begin()->first;
         }
 
-        while (this->cycles.size() > 1) {
-            int second = -1;
-            for (const auto &cycle: this->cycles) {
-                if (cycle.first != bad) {
-                    second = cycle.first;
-                }
-            }
-            TwoCycles twoCycles(bad, second);
-            twoCycles.JoinCycles(this);
+        auto &remaining_cycles = buffers.cycles_to_join;
+        remaining_cycles.clear();
+        remaining_cycles.reserve(this->cycles.size());
+        for (const auto &cycle: this->cycles) {
+            remaining_cycles.push_back(cycle.first);
         }
+        JoinAll(bad, remaining_cycles);
 
-        auto cycle = this->cycles.at(bad);
-        approximation = cycle.GetCycle();
+        this->cycles.at(bad).GetCycle(tour);
     }
 
-    vector<int> GetApproximation() {
-        return approximation;
+    /**
+     * Joins cycles one by one to the root cycle
+     * Each join splices a cycle into the root in O(1), so the whole stage is linear in number of cycles
+     * @param root - index of cycle, to which all cycles are joined
+     * @param cycles_to_join - indexes of cycles, root may be among them
+     */
+    void JoinAll(int root, const vector<int> &cycles_to_join) {
+        for (auto cycle: cycles_to_join) {
+            if (cycle != root) {
+                TwoCycles twoCycles(root, cycle);
+                twoCycles.JoinCycles(this, nullptr);
+            }
+        }
     }
 
-private:
+    /**
+     * Splits every component of the directed graph and joins cycles of its parts (see SplitComponent)
+     *
+     * Components have disjoint cycles, vertexes and sets of cycle_sets, so chunks of consecutive components
+     * are split in parallel. Every thread has its own SplitWorker with buffers and arena, workers only read
+     * cycles and bad_cycles, and joins, which erase cycles or make them bad, are logged per chunk
+     * and applied after all chunks in order of components, so the result doesn't depend on the number of threads
+     */
     void SplitDirectedGraph() {
-        auto start_vertexes = directed_graph.FindComponents();
-        for (auto start_vertex: start_vertexes) {
-            SplitComponent(start_vertex);
+        SolveStats::Phase phase(options.stats, "split components", &arena);
+        const auto &start_vertexes = directed_graph.FindComponents();
+        is_leaf.assign(directed_graph.Size(), false);
+        while (split_workers.size() < static_cast<size_t>(Threads())) {
+            split_workers.push_back(std::make_unique<SplitWorker>());
         }
+        for (auto &worker: split_workers) {
+            worker->counters = SplitCounters();
+            // chunks go to workers in any order, so buffers are sized for any component at once
+            worker->Reserve(directed_graph.Size());
+        }
+
+        int num_components = start_vertexes.size();
+        int num_chunks = std::min(num_components, Threads() * CHUNKS_PER_THREAD);
+        auto &logs = buffers.split_logs;
+        logs.resize(num_chunks);
+        RunParallel(num_chunks, [&](int chunk, int thread) {
+            auto &worker = *split_workers[thread];
+            // containers on the arena live only during a join, so the arena is sized by the largest chunk
+            worker.arena.Reset();
+            worker.log = &logs[chunk];
+            worker.log->joined_cycles.clear();
+            worker.log->bad_cycles.clear();
+            int end = static_cast<long long>(chunk + 1) * num_components / num_chunks;
+            for (int i = static_cast<long long>(chunk) * num_components / num_chunks; i < end; ++i) {
+                SplitComponent(start_vertexes[i], worker);
+            }
+        });
+
+        // as buffers, arenas of workers are grown to the largest chunk of any of them
+        size_t arena_size = 0;
+        for (const auto &worker: split_workers) {
+            arena_size = std::max(arena_size, worker->arena.Capacity());
+        }
+        for (auto &worker: split_workers) {
+            worker->arena.Reserve(arena_size);
+        }
+
+        assert(LogsAreDisjoint(logs));
+        // a cycle made bad by a join may be joined to another cycle later, so all erasures go last
+        for (const auto &log: logs) {
+            for (int cycle_idx: log.bad_cycles) {
+                bad_cycles.emplace(cycle_idx);
+            }
+        }
+        for (const auto &log: logs) {
+            for (int cycle_idx: log.joined_cycles) {
+                cycles.erase(cycle_idx);
+                bad_cycles.erase(cycle_idx);
+            }
+        }
+
+        SplitCounters counters;
+        for (const auto &worker: split_workers) {
+            counters.subtrees += worker->counters.subtrees;
+            counters.paths += worker->counters.paths;
+            counters.three_cycles += worker->counters.three_cycles;
+        }
+        phase.Count("components", start_vertexes.size());
+        phase.Count("chunks", num_chunks);
+        phase.Count("subtrees", counters.subtrees);
+        phase.Count("paths", counters.paths);
+        phase.Count("three_cycles", counters.three_cycles);
     }
 
     /**
      * Split component on subtrees with max depth 1, paths of length 1 and no more than one path of length 2
-     * @param start_vertex - vertex, from which we can call CycleDfs and go over all vertex in component
+     * @param start_vertex - vertex, from which we can go over all vertex in component
+     * @param worker - buffers, arena and log of joins of the calling thread
      */
-    void SplitComponent(int start_vertex) {
-        auto cycle = directed_graph.FindCycle(start_vertex);
+    void SplitComponent(int start_vertex, SplitWorker &worker) {
+        directed_graph.FindCycle(start_vertex, worker.cycle);
+        const auto &cycle = worker.cycle;
 
         if (cycle.size() == 1) {
-            SplitDfs(start_vertex);
+            SplitTree(start_vertex, worker);
             return;
         }
 
-        // key - index of vertex in cycle
-        // value - distance to closest vertex in cycle that has subtree
-        unordered_map<int, int> has_subtree;
-        unordered_set<int> cycle_vertexes;
-        for (auto v: cycle) {
-            cycle_vertexes.emplace(v);
-            if (directed_graph.GetEdges().at(v).size() > 1) {
-                has_subtree.emplace(v, 0);
+        // index - index of vertex in cycle
+        // value - distance to closest vertex in cycle that has subtree, or -1 if vertex has no subtree
+        int size = cycle.size();
+        auto &has_subtree = worker.has_subtree;
+        has_subtree.assign(size, -1);
+        bool any_subtree = false;
+        for (int i = 0; i < size; ++i) {
+            if (directed_graph.GetChildren(cycle[i]).size() > 1) {
+                has_subtree[i] = 0;
+                any_subtree = true;
             }
         }
 
         // calc distance to closest vertex from cycle which has subtree
         int prev = -1;
         int first = -1;
-        for (int i = 0; i < cycle.size(); ++i) {
-            if (has_subtree.find(cycle[i]) != has_subtree.end()) {
+        for (int i = 0; i < size; ++i) {
+            if (has_subtree[i] != -1) {
                 if (first != -1) {
-                    has_subtree.find(cycle[prev])->second = i - prev - 1;
+                    has_subtree[prev] = i - prev - 1;
                 } else {
                     first = i;
                 }
@@ -174,20 +951,22 @@ private:
             }
         }
 
-        int last_part = cycle.size() - 1 - prev;
-        if (!has_subtree.empty()) {
-            has_subtree.find(cycle[prev])->second = last_part + first;
+        int last_part = size - 1 - prev;
+        if (any_subtree) {
+            has_subtree[prev] = last_part + first;
         }
-        unordered_set<int> used;
+        auto &used = worker.used;
+        used.assign(size, false);
+        bool any_used = false;
 
         // find subtrees with max depth 1 and join them
-        for (auto v: has_subtree) {
-            if (used.find(v.first) == used.end()) {
-                unordered_set<int> leaves;
+        for (int i = 0; i < size; ++i) {
+            if (has_subtree[i] != -1 && !used[i]) {
+                CycleSet leaves(&worker.arena);
                 int cycle_leaf = -1;
-                for (auto u: directed_graph.GetEdges().at(v.first)) {
-                    if (cycle_vertexes.find(u) == cycle_vertexes.end()) {
-                        if (SplitDfs(u)) {
+                for (auto u: directed_graph.GetChildren(cycle[i])) {
+                    if (!directed_graph.IsOnCycle(u)) {
+                        if (SplitTree(u, worker)) {
                             leaves.emplace(u);
                         }
                     } else {
@@ -195,17 +974,16 @@ private:
                     }
                 }
                 if (!leaves.empty()) {
-                    used.emplace(v.first);
-                    assert(cycle_leaf != -1);
-                    if (has_subtree.at(v.first) % 2 == 0) {
-                        SubTree subTree(v.first, leaves);
-                        subTree.JoinCycles(this);
-                    } else {
+                    used[i] = true;
+                    any_used = true;
+                    assert(cycle_leaf == cycle[(i + 1) % size]);
+                    if (has_subtree[i] % 2 != 0) {
                         leaves.emplace(cycle_leaf);
-                        used.emplace(cycle_leaf);
-                        SubTree subTree(v.first, leaves);
-                        subTree.JoinCycles(this);
+                        used[(i + 1) % size] = true;
                     }
+                    SubTree subTree(cycle[i], std::move(leaves));
+                    subTree.JoinCycles(this, &worker);
+                    worker.counters.subtrees++;
                 }
             }
         }
@@ -213,32 +991,37 @@ private:
         // split rest of the cycle on paths of length 1 and no more than one path of length 2
         int start = 1;
         int end = 0;
-        if (!used.empty()) {
-            for (int i = 0; i < cycle.size(); ++i) {
-                if (used.find(cycle[i]) != used.end()) {
-                    start = (i + 1) % cycle.size();
+        if (any_used) {
+            for (int i = 0; i < size; ++i) {
+                if (used[i]) {
+                    start = (i + 1) % size;
                     end = i;
                 }
             }
         }
 
-        for (size_t i = start; i != end; i = (i + 1) % cycle.size()) {
-            if (used.find(cycle[i]) == used.end()) {
-                size_t next = (i + 1) % cycle.size();
-                size_t nextnext = (next + 1) % cycle.size();
-                if (used.find(cycle[next]) == used.end()) {
+        for (int i = start; i != end; i = (i + 1) % size) {
+            if (!used[i]) {
+                int next = (i + 1) % size;
+                int nextnext = (next + 1) % size;
+                if (!used[next]) {
                     if (nextnext != end) {
-                        SubTree subTree(cycle[i], {cycle[next]});
-                        subTree.JoinCycles(this);
+                        SubTree subTree(cycle[i], CycleSet({cycle[next]}, 0, &worker.arena));
+                        subTree.JoinCycles(this, &worker);
+                        worker.counters.paths++;
                         i = next;
                         if (i == end) return;
                     } else {
-                        if (used.find(cycle[nextnext]) == used.end()) {
-                            ThreeCycles threeCycles(cycle[i], cycle[next], cycle[nextnext]);
-                            threeCycles.JoinCycles(this);
+                        if (!used[nextnext]) {
+                            // every next cycle is a child of previous, so connected edges go
+                            // from cycle[nextnext] to cycle[next] and from cycle[next] to cycle[i]
+                            ThreeCycles threeCycles(cycle[nextnext], cycle[next], cycle[i]);
+                            threeCycles.JoinCycles(this, &worker);
+                            worker.counters.three_cycles++;
                         } else {
-                            SubTree subTree(cycle[i], {cycle[next]});
-                            subTree.JoinCycles(this);
+                            SubTree subTree(cycle[i], CycleSet({cycle[next]}, 0, &worker.arena));
+                            subTree.JoinCycles(this, &worker);
+                            worker.counters.paths++;
                         }
 
                         return;
@@ -249,44 +1032,49 @@ private:
     }
 
     /**
-     *
-     * @param v - vertex from vhich dfs is called
-     * @return - true if this node should be leaf, false - if root
+     * Joins cycles of a tree in subtrees with max depth 1, going from the deepest cycles to the root
+     * @param root - root of the tree
+     * @return - true if root should be leaf, false - if root
      */
-    bool SplitDfs(int v) {
-        if (directed_graph.GetEdges().at(v).empty()) {
-            return true;
-        }
-        unordered_set<int> leaves;
-        for (auto u: directed_graph.GetEdges().at(v)) {
-            if (SplitDfs(u)) {
-                leaves.emplace(u);
+    bool SplitTree(int root, SplitWorker &worker) {
+        directed_graph.FindTreeOrder(root, worker.order);
+        const auto &order = worker.order;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            int v = *it;
+            CycleSet leaves(&worker.arena);
+            for (auto u: directed_graph.GetChildren(v)) {
+                if (!directed_graph.IsOnCycle(u) && is_leaf[u]) {
+                    leaves.emplace(u);
+                }
+            }
+            if (!leaves.empty()) {
+                SubTree subTree(v, std::move(leaves));
+                subTree.JoinCycles(this, &worker);
+                worker.counters.subtrees++;
+                is_leaf[v] = false;
+            } else {
+                is_leaf[v] = true;
             }
         }
-        if (!leaves.empty()) {
-            SubTree subTree(v, leaves);
-            subTree.JoinCycles(this);
-            return false;
-        } else {
-            return true;
-        }
+        return is_leaf[root];
     }
 
     class SmallGraph {
         /**
          *
          * @param travellingSalesmanProblemApproximation
+         * @param worker - worker of SplitDirectedGraph, which makes the join, or nullptr
          * @return index of joined cycle
          */
-        virtual int JoinCycles(TSPApproximation *travellingSalesmanProblemApproximation) = 0;
+        virtual int JoinCycles(BasicTSPApproximation *travellingSalesmanProblemApproximation, SplitWorker *worker) = 0;
     };
 
     class TwoCycles : public SmallGraph {
     public:
         TwoCycles(int first_cycle, int second_cycle) : first_cycle(first_cycle), second_cycle(second_cycle) {}
 
-        int JoinCycles(TSPApproximation *travellingSalesmanProblemApproximation) override {
-            travellingSalesmanProblemApproximation->JoinTwoCycles(first_cycle, second_cycle);
+        int JoinCycles(BasicTSPApproximation *travellingSalesmanProblemApproximation, SplitWorker *worker) override {
+            travellingSalesmanProblemApproximation->JoinTwoCycles(first_cycle, second_cycle, worker);
             return first_cycle;
         }
 
@@ -301,8 +1089,8 @@ private:
                                                                           second_cycle(second_cycle),
                                                                           third_cycle(third_cycle) {}
 
-        int JoinCycles(TSPApproximation *travellingSalesmanProblemApproximation) override {
-            travellingSalesmanProblemApproximation->JoinThreeCycles(first_cycle, second_cycle, third_cycle);
+        int JoinCycles(BasicTSPApproximation *travellingSalesmanProblemApproximation, SplitWorker *worker) override {
+            travellingSalesmanProblemApproximation->JoinThreeCycles(first_cycle, second_cycle, third_cycle, worker);
             return first_cycle;
         }
 
@@ -314,14 +1102,15 @@ private:
 
     class SubTree : public SmallGraph {
     public:
-        SubTree(int root_cycle, const unordered_set<int> &cycles) : root_cycle(root_cycle), cycles(cycles) {}
+        SubTree(int root_cycle, CycleSet cycles) : root_cycle(root_cycle), cycles(std::move(cycles)) {}
 
-        int JoinCycles(TSPApproximation *tspApproximation) override {
+        int JoinCycles(BasicTSPApproximation *tspApproximation, SplitWorker *worker) override {
             auto &root = tspApproximation->cycles.at(root_cycle);
 
             // key - index of vertex in root cycle
             // value - index of non root cycle which is connected by edge with root cycle
-            unordered_map<int, int> connected_edges;
+            std::pmr::unordered_map<int, int> connected_edges(
+                    worker != nullptr ? &worker->arena : &tspApproximation->arena);
 
             for (auto cycle: cycles) {
                 auto &c = tspApproximation->cycles.at(cycle);
@@ -346,7 +1135,10 @@ private:
                     if (connected_edges.find(second) != connected_edges.end()) {
                         tspApproximation->JoinThreeCyclesWithRoot(root_cycle,
                                                                   connected_edges.find(first)->second,
-                                                                  connected_edges.find(second)->second);
+                                                                  connected_edges.find(second)->second, worker);
+                        // if every vertex of the root is connected, last is joined here, not after the loop
+                        connected_edges.erase(first);
+                        connected_edges.erase(second);
                         first = second;
                         second = root.GetSecond(first);
                         if (second == last) {
@@ -354,7 +1146,7 @@ private:
                             break;
                         }
                     } else {
-                        tspApproximation->JoinTwoCyclesWithRoot(root_cycle, connected_edges.find(first)->second);
+                        tspApproximation->JoinTwoCyclesWithRoot(root_cycle, connected_edges.find(first)->second, worker);
                     }
                 }
 
@@ -363,7 +1155,7 @@ private:
             }
 
             if (connected_edges.find(first) != connected_edges.end()) {
-                tspApproximation->JoinTwoCyclesWithRoot(root_cycle, connected_edges.find(first)->second);
+                tspApproximation->JoinTwoCyclesWithRoot(root_cycle, connected_edges.find(first)->second, worker);
             }
 
             return root_cycle;
@@ -371,10 +1163,10 @@ private:
 
     private:
         int root_cycle;
-        unordered_set<int> cycles;
+        CycleSet cycles;
     };
 
-    void JoinThreeCyclesWithRoot(int root_idx, int left_child_idx, int right_child_idx) {
+    void JoinThreeCyclesWithRoot(int root_idx, int left_child_idx, int right_child_idx, SplitWorker *worker = nullptr) {
         auto &root = cycles.at(root_idx);
         auto &c1 = cycles.at(left_child_idx);
         auto &c2 = cycles.at(right_child_idx);
@@ -383,29 +1175,21 @@ private:
         auto e2 = c2.GetConnectedEdge();
 
         assert(root.GetSecond(e1.second) == e2.second);
-        root.ChangeEdge(e1.second, e1.first, 1);
-
         int new_1 = c1.GetPrev(e1.first);
         int new_2 = c2.GetSecond(e2.first);
+        root.ChangeEdge(e1.second, e1.first, 1);
 
-        c1.ChangeEdge(new_1, new_2, graph.GetEdgeWeight(new_1, new_2));
+        c1.ChangeEdge(new_1, new_2, graph->GetEdgeWeight(new_1, new_2));
         c2.ChangeEdge(e2.first, e2.second, 1);
-        assert(graph.GetEdgeWeight(e2.first, e2.second) == 1);
+        assert(graph->GetEdgeWeight(e2.first, e2.second) == 1);
         root.AddCycle(c1);
         root.AddCycle(c2);
-        for (auto v: root.GetEdges()) {
-            SetCycle(v.first, root_idx);
-        }
-        if (!root.IsGood() && (bad_cycles.find(root_idx) == bad_cycles.end())) {
-            bad_cycles.emplace(root_idx);
-        }
-        cycles.erase(left_child_idx);
-        cycles.erase(right_child_idx);
-        bad_cycles.erase(left_child_idx);
-        bad_cycles.erase(right_child_idx);
+        cycle_sets.Union(root_idx, left_child_idx);
+        cycle_sets.Union(root_idx, right_child_idx);
+        FinishJoin(root_idx, {left_child_idx, right_child_idx}, worker);
     }
 
-    void JoinThreeCycles(int idx1, int idx2, int idx3) {
+    void JoinThreeCycles(int idx1, int idx2, int idx3, SplitWorker *worker = nullptr) {
         auto &c1 = cycles.at(idx1);
         auto &c2 = cycles.at(idx2);
         auto &c3 = cycles.at(idx3);
@@ -413,106 +1197,273 @@ private:
         auto e1 = c1.GetConnectedEdge();
         auto e2 = c2.GetConnectedEdge();
 
+        // previous vertexes are taken before any edge is changed
+        auto prev2 = c2.GetPrev(e1.second);
+        auto prev3 = c3.GetPrev(e2.second);
+
         auto new_end2 = c1.GetSecond(e1.first);
         c1.ChangeEdge(e1.first, e1.second, 1);
-        assert(graph.GetEdgeWeight(e1.first, e1.second) == 1);
+        assert(graph->GetEdgeWeight(e1.first, e1.second) == 1);
 
-        c2.ChangeEdge(c2.GetPrev(e1.second), new_end2,
-                      graph.GetEdgeWeight(c2.GetPrev(e1.second), new_end2));
+        c2.ChangeEdge(prev2, new_end2, graph->GetEdgeWeight(prev2, new_end2));
 
         auto new_end3 = c2.GetSecond(e2.first);
         c2.ChangeEdge(e2.first, e2.second, 1);
-        assert(graph.GetEdgeWeight(e2.first, e2.second) == 1);
+        assert(graph->GetEdgeWeight(e2.first, e2.second) == 1);
 
-        c3.ChangeEdge(c3.GetPrev(e2.second), new_end3,
-                      graph.GetEdgeWeight(c3.GetPrev(e2.second), new_end3));
+        c3.ChangeEdge(prev3, new_end3, graph->GetEdgeWeight(prev3, new_end3));
 
         c1.AddCycle(c2);
         c1.AddCycle(c3);
-        for (auto v: c1.GetEdges()) {
-            SetCycle(v.first, idx1);
-        }
-        if (!c1.IsGood() && (bad_cycles.find(idx1) == bad_cycles.end())) {
-            bad_cycles.emplace(idx1);
-        }
-        cycles.erase(idx2);
-        cycles.erase(idx3);
-        bad_cycles.erase(idx2);
-        bad_cycles.erase(idx3);
+        cycle_sets.Union(idx1, idx2);
+        cycle_sets.Union(idx1, idx3);
+        FinishJoin(idx1, {idx2, idx3}, worker);
     }
 
-    void JoinTwoCyclesWithRoot(int root_idx, int child_idx) {
+    void JoinTwoCyclesWithRoot(int root_idx, int child_idx, SplitWorker *worker = nullptr) {
         auto &root = cycles.at(root_idx);
         auto &c1 = cycles.at(child_idx);
 
         auto e1 = c1.GetConnectedEdge();
         auto new_1 = root.GetSecond(e1.second);
+        auto prev1 = c1.GetPrev(e1.first);
         root.ChangeEdge(e1.second, e1.first, 1);
-        assert(graph.GetEdgeWeight(e1.first, e1.second) == 1);
-        c1.ChangeEdge(c1.GetPrev(e1.first), new_1, graph.GetEdgeWeight(c1.GetPrev(e1.first), new_1));
+        assert(graph->GetEdgeWeight(e1.first, e1.second) == 1);
+        c1.ChangeEdge(prev1, new_1, graph->GetEdgeWeight(prev1, new_1));
         root.AddCycle(c1);
-        for (auto v: root.GetEdges()) {
-            SetCycle(v.first, root_idx);
-        }
-        if (!root.IsGood() && (bad_cycles.find(root_idx) == bad_cycles.end())) {
-            bad_cycles.emplace(root_idx);
-        }
-        cycles.erase(child_idx);
-        bad_cycles.erase(child_idx);
+        cycle_sets.Union(root_idx, child_idx);
+        FinishJoin(root_idx, {child_idx}, worker);
     }
 
-    void JoinTwoCycles(int c1_idx, int c2_idx) {
+    void JoinTwoCycles(int c1_idx, int c2_idx, SplitWorker *worker = nullptr) {
         auto &c1 = cycles.at(c1_idx);
         auto &c2 = cycles.at(c2_idx);
         auto c1_delete_edge = c1.GetEdgeOfMaximumWeight();
         auto c2_delete_edge = c2.GetEdgeOfMaximumWeight();
         c1.ChangeEdge(c1_delete_edge.first,
                       c2_delete_edge.second,
-                      graph.GetEdgeWeight(c1_delete_edge.first, c2_delete_edge.second));
+                      graph->GetEdgeWeight(c1_delete_edge.first, c2_delete_edge.second));
         c2.ChangeEdge(c2_delete_edge.first,
                       c1_delete_edge.second,
-                      graph.GetEdgeWeight(c2_delete_edge.first, c1_delete_edge.second));
+                      graph->GetEdgeWeight(c2_delete_edge.first, c1_delete_edge.second));
         c1.AddCycle(c2);
-        for (auto v: c1.GetEdges()) {
-            SetCycle(v.first, c1_idx);
+        cycle_sets.Union(c1_idx, c2_idx);
+        FinishJoin(c1_idx, {c2_idx}, worker);
+    }
+
+    /**
+     * Check for debug mode: components are disjoint, so every cycle is joined at most once in all chunks
+     * and every joined cycle still exists
+     */
+    bool LogsAreDisjoint(const vector<SplitLog> &logs) const {
+        vector<int> joined;
+        for (const auto &log: logs) {
+            joined.insert(joined.end(), log.joined_cycles.begin(), log.joined_cycles.end());
         }
-        if (!c1.IsGood() && (bad_cycles.find(c1_idx) == bad_cycles.end())) {
-            bad_cycles.emplace(c1_idx);
+        std::sort(joined.begin(), joined.end());
+        if (std::adjacent_find(joined.begin(), joined.end()) != joined.end()) {
+            return false;
         }
-        cycles.erase(c2_idx);
-        bad_cycles.erase(c2_idx);
+        return std::all_of(joined.begin(), joined.end(), [&](int cycle_idx) { return cycles.count(cycle_idx) != 0; });
     }
 
-    int GetCycle(int vertex) {
-        return vertexes.find(vertex)->second;
+    /**
+     * Adds joined cycle to bad_cycles, if it has heavy edges, and removes cycles joined to it
+     * @param worker - if not nullptr, changes are only logged, to be applied by SplitDirectedGraph
+     */
+    void FinishJoin(int joined_idx, std::initializer_list<int> removed, SplitWorker *worker) {
+        bool bad = !cycles.at(joined_idx).IsGood();
+        if (worker != nullptr) {
+            if (bad) {
+                worker->log->bad_cycles.push_back(joined_idx);
+            }
+            worker->log->joined_cycles.insert(worker->log->joined_cycles.end(), removed);
+            return;
+        }
+        if (bad) {
+            bad_cycles.emplace(joined_idx);
+        }
+        for (int cycle_idx: removed) {
+            cycles.erase(cycle_idx);
+            bad_cycles.erase(cycle_idx);
+        }
     }
 
-    void SetCycle(int vertex, int cycle_num) {
-        if (vertexes.find(vertex) == vertexes.end()) {
-            vertexes.emplace(vertex, cycle_num);
-        } else {
-            vertexes.find(vertex)->second = cycle_num;
-        }
+    /**
+     * @return index of cycle, in which vertex is
+     */
+    int GetCycle(int vertex) {
+        return cycle_sets.GetLabel(vertexes[vertex]);
     }
 
-    void AddCycle(const vector<int> &cycle) {
-        // set index of cycle for each vertex
-        for (auto vertex: cycle) {
-            SetCycle(vertex, cycles.size());
+    void AddCycle(const int *cycle, int size) {
+        // set index of initial cycle for each vertex
+        for (int i = 0; i < size; ++i) {
+            vertexes[cycle[i]] = cycles.size();
         }
-        Cycle c(cycle, graph);
+        auto weight = [this](int first, int second) {
+            if (!graph->IsMapped()) {
+                return graph->GetEdgeWeight(first, second);
+            }
+            // the cycle may be reversed
+            const auto &next = buffers.next_vertex;
+            return static_cast<int>(next[first] == second ? buffers.next_weight[first] : buffers.next_weight[second]);
+        };
+        Cycle c(cycle, size, weight, links);
         if (!c.IsGood()) {
             bad_cycles.emplace(cycles.size());
         }
         cycles.emplace(cycles.size(), c);
     }
 
-    unordered_set<int> bad_cycles; // storage of cycles which has heavy edges
-    unordered_map<int, int> vertexes; // value - index of cycle, in which vertex is
-    Graph graph;
-    unordered_map<int, Cycle> cycles;
+    /**
+     * Number of joins of each kind made by SplitDirectedGraph
+     */
+    struct SplitCounters {
+        long long subtrees = 0;
+        long long paths = 0;
+        long long three_cycles = 0;
+    };
+
+    /**
+     * Joins of a chunk of components, which change cycles and bad_cycles, in order
+     */
+    struct SplitLog {
+        vector<int> joined_cycles; // joined to other cycles, to be erased
+        vector<int> bad_cycles; // got heavy edges by a join
+    };
+
+    /**
+     * State of one thread of SplitDirectedGraph, kept between constructions
+     */
+    struct SplitWorker {
+        Arena arena; // memory of hash containers of joins
+        vector<int> cycle; // cycle of the current component, see DirectedGraph::FindCycle
+        vector<int> order; // see DirectedGraph::FindTreeOrder
+        vector<int> has_subtree;
+        vector<char> used;
+        SplitLog *log = nullptr; // log of the current chunk
+        SplitCounters counters;
+
+        void Reserve(size_t size) {
+            cycle.reserve(size);
+            order.reserve(size);
+            has_subtree.reserve(size);
+            used.reserve(size);
+        }
+    };
+
+    /**
+     * Temporary arrays of phases, kept between constructions to reuse their memory
+     */
+    struct Buffers {
+        vector<int> cycle_order;
+        vector<int> cycle;
+        vector<int> next_vertex; // mapped graph: next vertex in the given cycle
+        vector<int> edge_end;
+        vector<char> edge_weight;
+        vector<char> next_weight; // mapped graph: weight of the edge to next_vertex
+        vector<int> cycles_to_join;
+        vector<int> good_cycles;
+        vector<int> chunk_begin;
+        vector<vector<BipartiteEdge>> chunk_edges;
+        vector<vector<int>> chunk_cycles; // mapped graph: cycle of every edge of chunk_edges
+        vector<int> cycle_of; // mapped graph: cycle of every vertex
+        vector<int> rows;
+        vector<int> offsets;
+        vector<BipartiteEdge> adjacency;
+        vector<CandidatesBuffer> candidates;
+        vector<pair<int, pair<int, int>>> matching;
+        vector<SplitLog> split_logs; // for chunk of components of SplitDirectedGraph
+    };
+
+    ApproximationOptions options;
+    Arena arena; // memory of hash containers, released at once with the approximation
+    Graph owned_graph; // graph, if it is not shared with other approximations
+    const Graph *graph; // owned_graph or graph of the caller
+    std::mt19937_64 random; // used only if options.seed is not 0
+    CycleSet bad_cycles{&arena}; // storage of cycles which has heavy edges
+    IndexArray<Index> vertexes; // index of initial cycle, in which vertex is
+    UnionFind cycle_sets; // sets of initial cycles joined in one cycle, labeled by index of joined cycle
+    std::pmr::unordered_map<int, Cycle> cycles{&arena};
+    CycleLinks links; // edges of all cycles
     vector<int> approximation{};
+    BipartiteGraph bipartite_graph; // good cycles and vertexes, built by BuildBipartiteGraph
     DirectedGraph directed_graph;
+    vector<char> is_leaf; // for cycle in directed graph: true if cycle should be a leaf of subtree, found by SplitTree
+    vector<std::unique_ptr<SplitWorker>> split_workers; // for thread of SplitDirectedGraph
+    Buffers buffers;
+    std::unique_ptr<ThreadPool> pool; // created by the first parallel phase
+};
+
+/**
+ * TSP approximation by BasicTSPApproximation with the narrowest index type, which fits the number of vertexes
+ * (see DispatchIndex)
+ * Constructors are the same as constructors of BasicTSPApproximation, the ones without cycles
+ * use the experimental CycleCover
+ */
+class TSPApproximation {
+public:
+    TSPApproximation(const vector<vector<int>> &edges, const vector<vector<int>> &cycles,
+                     const ApproximationOptions &options = ApproximationOptions()) {
+        Create(edges.size(), edges, cycles, options);
+    }
+
+    explicit TSPApproximation(const vector<vector<int>> &edges,
+                              const ApproximationOptions &options = ApproximationOptions()) {
+        Create(edges.size(), edges, options);
+    }
+
+    TSPApproximation(int n, const vector<pair<int, int>> &light_edges, const vector<vector<int>> &cycles,
+                     const ApproximationOptions &options = ApproximationOptions()) {
+        Create(n, n, light_edges, cycles, options);
+    }
+
+    TSPApproximation(int n, const vector<pair<int, int>> &light_edges,
+                     const ApproximationOptions &options = ApproximationOptions()) {
+        Create(n, n, light_edges, options);
+    }
+
+    TSPApproximation(const Graph &graph, const FlatCycles &cycles,
+                     const ApproximationOptions &options = ApproximationOptions()) {
+        Create(graph.Size(), graph, cycles, options);
+    }
+
+    TSPApproximation(const Graph &graph, const ApproximationOptions &options) {
+        Create(graph.Size(), graph, options);
+    }
+
+    vector<int> GetApproximation() {
+        return DispatchIndex(n, [&](auto index) {
+            return Approximation<decltype(index)>()->GetApproximation();
+        });
+    }
+
+private:
+    /**
+     * Creates the approximation of index type for n vertexes with arguments of its constructor
+     */
+    template<typename... Arguments>
+    void Create(int n, const Arguments &... arguments) {
+        this->n = n;
+        DispatchIndex(n, [&](auto index) {
+            using Index = decltype(index);
+            Approximation<Index>() = std::make_unique<BasicTSPApproximation<Index>>(arguments...);
+        });
+    }
+
+    template<typename Index>
+    std::unique_ptr<BasicTSPApproximation<Index>> &Approximation() {
+        if constexpr (std::is_same<Index, NarrowIndex>::value) {
+            return narrow;
+        } else {
+            return wide;
+        }
+    }
+
+    int n = 0;
+    std::unique_ptr<BasicTSPApproximation<NarrowIndex>> narrow; // graph of at most NARROW_INDEX_VERTEXES vertexes
+    std::unique_ptr<BasicTSPApproximation<int>> wide; // otherwise
 };
 
 
@@ -0,0 +1,311 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_TSPLIBREADER_H
+#define HELLOWORLD_TSPLIBREADER_H
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cctype>
+#include <stdexcept>
+#include <algorithm>
+#include "Graph.h"
+
+using std::vector;
+using std::pair;
+using std::string;
+
+/**
+ * Instance read from TSPLIB file: only light edges are kept, all other edges have weight 2
+ */
+struct TSPLIBInstance {
+    string name;
+    int dimension = 0;
+    vector<pair<int, int>> light_edges; // each pair once, first < second
+};
+
+/**
+ * Streaming reader of TSPLIB files with explicit weights 1 and 2
+ *
+ * Supports EDGE_WEIGHT_TYPE: EXPLICIT with EDGE_WEIGHT_FORMAT FULL_MATRIX, UPPER_ROW, LOWER_ROW, UPPER_DIAG_ROW,
+ * LOWER_DIAG_ROW and their _COL variants. The file is read by blocks of BUFFER_SIZE bytes and numbers are scanned
+ * in place, matrix is never stored: memory is O(n + number of light edges).
+ * Errors (unsupported format, weights other than 1 and 2 off the diagonal, truncated file) throw std::runtime_error.
+ */
+class TSPLIBReader {
+public:
+    explicit TSPLIBReader(const string &path) : path(path), buffer(BUFFER_SIZE + 1, 0) {
+        file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            throw std::runtime_error("can't open " + path);
+        }
+    }
+
+    TSPLIBReader(const TSPLIBReader &) = delete;
+
+    TSPLIBReader &operator=(const TSPLIBReader &) = delete;
+
+    ~TSPLIBReader() {
+        std::fclose(file);
+    }
+
+    static TSPLIBInstance Read(const string &path) {
+        return TSPLIBReader(path).Read();
+    }
+
+    TSPLIBInstance Read() {
+        TSPLIBInstance instance;
+        string format = "FULL_MATRIX";
+        string line;
+        while (true) {
+            if (!ReadLine(line)) {
+                Fail("no EDGE_WEIGHT_SECTION");
+            }
+            string key;
+            string value;
+            SplitLine(line, key, value);
+            if (key.empty()) {
+                continue;
+            }
+            if (key == "EDGE_WEIGHT_SECTION") {
+                break;
+            }
+            if (key == "NAME") {
+                instance.name = value;
+            } else if (key == "TYPE") {
+                if (value != "TSP") {
+                    Fail("TYPE " + value + " is not supported");
+                }
+            } else if (key == "DIMENSION") {
+                instance.dimension = ParseDimension(value);
+            } else if (key == "EDGE_WEIGHT_TYPE") {
+                if (value != "EXPLICIT") {
+                    Fail("EDGE_WEIGHT_TYPE " + value + " is not supported");
+                }
+            } else if (key == "EDGE_WEIGHT_FORMAT") {
+                format = value;
+            } else if (key == "EOF" || (key.size() > 8 && key.compare(key.size() - 8, 8, "_SECTION") == 0)) {
+                Fail(key + " before EDGE_WEIGHT_SECTION");
+            }
+        }
+        if (instance.dimension <= 0) {
+            Fail("no DIMENSION");
+        }
+        ReadWeights(instance, format);
+        return instance;
+    }
+
+private:
+    const static size_t BUFFER_SIZE = 1 << 20;
+    const static int MAX_FAST_DIGITS = 9; // longer numbers may overflow, they are scanned by the slow path
+
+    /**
+     * Order of entries of the matrix
+     */
+    enum class Layout {
+        FULL, // every row fully
+        UPPER, // row i: columns i + 1..n - 1
+        LOWER, // row i: columns 0..i - 1
+        UPPER_DIAG, // row i: columns i..n - 1
+        LOWER_DIAG // row i: columns 0..i
+    };
+
+    void ReadWeights(TSPLIBInstance &instance, const string &format) {
+        // column layouts list the same entries as row layouts of the transposed, that is the same, matrix
+        Layout layout;
+        if (format == "FULL_MATRIX") {
+            layout = Layout::FULL;
+        } else if (format == "UPPER_ROW" || format == "LOWER_COL") {
+            layout = Layout::UPPER;
+        } else if (format == "LOWER_ROW" || format == "UPPER_COL") {
+            layout = Layout::LOWER;
+        } else if (format == "UPPER_DIAG_ROW" || format == "LOWER_DIAG_COL") {
+            layout = Layout::UPPER_DIAG;
+        } else if (format == "LOWER_DIAG_ROW" || format == "UPPER_DIAG_COL") {
+            layout = Layout::LOWER_DIAG;
+        } else {
+            Fail("EDGE_WEIGHT_FORMAT " + format + " is not supported");
+        }
+
+        int n = instance.dimension;
+        for (int row = 0; row < n; ++row) {
+            int begin = 0;
+            int end = n;
+            switch (layout) {
+                case Layout::FULL:
+                    break;
+                case Layout::UPPER:
+                    begin = row + 1;
+                    break;
+                case Layout::LOWER:
+                    end = row;
+                    break;
+                case Layout::UPPER_DIAG:
+                    begin = row;
+                    break;
+                case Layout::LOWER_DIAG:
+                    end = row + 1;
+                    break;
+            }
+            for (int column = begin; column < end; ++column) {
+                int weight = ReadNumber();
+                if (row == column) {
+                    continue;
+                }
+                if (weight == LIGHT_EDGE) {
+                    // full matrix lists every pair twice
+                    if (layout != Layout::FULL || row < column) {
+                        instance.light_edges.emplace_back(std::min(row, column), std::max(row, column));
+                    }
+                } else if (weight != HEAVY_EDGE) {
+                    Fail("weight of edge (" + std::to_string(row) + ", " + std::to_string(column) + ") is not 1 or 2");
+                }
+            }
+        }
+    }
+
+    /**
+     * Refills buffer from the file
+     * @return false if the file is over
+     */
+    bool Fill() {
+        size = std::fread(buffer.data(), 1, BUFFER_SIZE, file);
+        buffer[size] = 0;
+        position = 0;
+        return size > 0;
+    }
+
+    /**
+     * @return next character or EOF
+     */
+    int Peek() {
+        if (position == size && !Fill()) {
+            return EOF;
+        }
+        return static_cast<unsigned char>(buffer[position]);
+    }
+
+    bool ReadLine(string &line) {
+        line.clear();
+        int c = Peek();
+        if (c == EOF) {
+            return false;
+        }
+        while ((c = Peek()) != EOF) {
+            ++position;
+            if (c == '\n') {
+                break;
+            }
+            line.push_back(static_cast<char>(c));
+        }
+        return true;
+    }
+
+    /**
+     * Scans non-negative integer, skipping whitespace before it
+     */
+    int ReadNumber() {
+        // fast path: the number ends inside the buffer, buffer[size] is a zero sentinel, so no bound checks
+        const char *begin = buffer.data() + position;
+        const char *current = begin;
+        while (IsSpace(*current)) {
+            ++current;
+        }
+        if (IsDigit(*current)) {
+            const char *digits = current;
+            unsigned number = 0;
+            while (IsDigit(*current)) {
+                number = number * 10 + (*current - '0');
+                ++current;
+            }
+            if (current < buffer.data() + size && current - digits <= MAX_FAST_DIGITS) {
+                position += current - begin;
+                return number;
+            }
+        }
+
+        int c = Peek();
+        while (IsSpace(c)) {
+            ++position;
+            c = Peek();
+        }
+        if (!IsDigit(c)) {
+            Fail(c == EOF ? "EDGE_WEIGHT_SECTION is truncated" : "EDGE_WEIGHT_SECTION has not a number");
+        }
+        long long number = 0;
+        while (IsDigit(c)) {
+            number = number * 10 + (c - '0');
+            if (number > HEAVY_EDGE) {
+                // the weight is wrong anyway, don't overflow
+                number = HEAVY_EDGE + 1;
+            }
+            ++position;
+            c = Peek();
+        }
+        return number;
+    }
+
+    static bool IsDigit(int c) {
+        return static_cast<unsigned>(c - '0') < 10;
+    }
+
+    static bool IsSpace(int c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    /**
+     * Splits "KEY : VALUE" or "KEY: VALUE" or "KEY", trims spaces
+     */
+    static void SplitLine(const string &line, string &key, string &value) {
+        auto colon = line.find(':');
+        key = Trim(line.substr(0, colon));
+        value = colon == string::npos ? "" : Trim(line.substr(colon + 1));
+    }
+
+    static string Trim(const string &text) {
+        size_t begin = 0;
+        size_t end = text.size();
+        while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+            ++begin;
+        }
+        while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+            --end;
+        }
+        return text.substr(begin, end - begin);
+    }
+
+    /**
+     * @return value of DIMENSION, fails if it is not a whole number in range of int
+     */
+    int ParseDimension(const string &value) const {
+        size_t end = 0;
+        int dimension = 0;
+        try {
+            dimension = std::stoi(value, &end);
+        } catch (const std::logic_error &) {
+            // std::invalid_argument or std::out_of_range
+            Fail("bad DIMENSION");
+        }
+        if (end != value.size()) {
+            Fail("bad DIMENSION");
+        }
+        return dimension;
+    }
+
+    [[noreturn]] void Fail(const string &message) const {
+        throw std::runtime_error(path + ": " + message);
+    }
+
+    string path;
+    std::FILE *file = nullptr;
+    vector<char> buffer; // BUFFER_SIZE bytes and zero after the last read byte
+    size_t size = 0; // number of bytes in buffer
+    size_t position = 0; // next byte in buffer
+};
+
+
+#endif //HELLOWORLD_TSPLIBREADER_H
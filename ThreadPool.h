@@ -0,0 +1,223 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_THREADPOOL_H
+#define HELLOWORLD_THREADPOOL_H
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+using std::vector;
+
+/**
+ * Pool of threads with work stealing
+ *
+ * Every worker has its own deque of tasks. Tasks submitted from a worker go to the back of its deque,
+ * tasks submitted from outside are distributed round-robin. A worker takes tasks from the back
+ * of its own deque and, when it is empty, steals from the front of the deques of other workers.
+ * Deques are ring buffers, which keep their memory, so a pool reused for batches of similar size stops allocating
+ * (closures of Task are stored in place, if they fit std::function, e.g. a reference and an index).
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @param num_threads - number of workers, if 0 - number of hardware threads
+     */
+    explicit ThreadPool(int num_threads = 0) {
+        if (num_threads <= 0) {
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (int i = 0; i < num_threads; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (int i = 0; i < num_threads; ++i) {
+            threads.emplace_back([this, i] { Run(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        has_tasks.notify_all();
+        for (auto &thread: threads) {
+            thread.join();
+        }
+    }
+
+    void Submit(Task task) {
+        ++pending;
+        int index = current_pool == this ? current_worker
+                                         : static_cast<int>(next_worker++ % workers.size());
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++queued;
+        }
+        has_tasks.notify_one();
+    }
+
+    /**
+     * Waits until all submitted tasks are finished, rethrows the first exception thrown by a task
+     */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [this] { return pending == 0; });
+        if (exception != nullptr) {
+            auto first_exception = exception;
+            exception = nullptr;
+            std::rethrow_exception(first_exception);
+        }
+    }
+
+    int Size() const {
+        return workers.size();
+    }
+
+    /**
+     * @return index of the worker running the calling thread, in [0, Size()) of its pool, or -1 outside of pools
+     */
+    static int CurrentWorker() {
+        return current_pool != nullptr ? current_worker : -1;
+    }
+
+private:
+    /**
+     * Deque of tasks in a ring buffer, which doubles when it is full and never shrinks
+     */
+    class TaskDeque {
+    public:
+        bool empty() const {
+            return count == 0;
+        }
+
+        void push_back(Task task) {
+            if (count == buffer.size()) {
+                Grow();
+            }
+            buffer[(head + count) % buffer.size()] = std::move(task);
+            ++count;
+        }
+
+        Task pop_back() {
+            --count;
+            return std::move(buffer[(head + count) % buffer.size()]);
+        }
+
+        Task pop_front() {
+            Task task = std::move(buffer[head]);
+            head = (head + 1) % buffer.size();
+            --count;
+            return task;
+        }
+
+    private:
+        void Grow() {
+            vector<Task> grown(std::max<size_t>(2 * buffer.size(), INITIAL_CAPACITY));
+            for (size_t i = 0; i < count; ++i) {
+                grown[i] = std::move(buffer[(head + i) % buffer.size()]);
+            }
+            buffer.swap(grown);
+            head = 0;
+        }
+
+        constexpr static size_t INITIAL_CAPACITY = 16;
+
+        vector<Task> buffer;
+        size_t head = 0; // index of the front task in buffer
+        size_t count = 0;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        TaskDeque tasks;
+    };
+
+    bool TryPop(int index, Task &task) {
+        auto &worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            return false;
+        }
+        task = worker.tasks.pop_back();
+        return true;
+    }
+
+    bool TrySteal(int index, Task &task) {
+        for (size_t i = 1; i < workers.size(); ++i) {
+            auto &victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Run(int index) {
+        current_pool = this;
+        current_worker = index;
+        while (true) {
+            Task task;
+            if (TryPop(index, task) || TrySteal(index, task)) {
+                --queued;
+                try {
+                    task();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (exception == nullptr) {
+                        exception = std::current_exception();
+                    }
+                }
+                if (--pending == 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    all_done.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            has_tasks.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+        }
+    }
+
+    static inline thread_local ThreadPool *current_pool = nullptr;
+    static inline thread_local int current_worker = 0;
+
+    vector<std::unique_ptr<Worker>> workers;
+    vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable has_tasks;
+    std::condition_variable all_done;
+    std::atomic<long long> queued{0}; // tasks in deques, incremented under mutex, so that no wakeup is lost
+    std::atomic<long long> pending{0}; // submitted and not finished tasks
+    std::atomic<size_t> next_worker{0};
+    std::exception_ptr exception;
+    bool stopping = false;
+};
+
+
+#endif //HELLOWORLD_THREADPOOL_H
@@ -0,0 +1,152 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_TOUREVALUATOR_H
+#define HELLOWORLD_TOUREVALUATOR_H
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "Graph.h"
+#include "BitMatrix.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HELLOWORLD_TOUREVALUATOR_AVX2
+#include <immintrin.h>
+#endif
+
+using std::vector;
+
+/**
+ * Result of TourEvaluator::Evaluate
+ */
+struct TourEvaluation {
+    bool valid = false; // tour visits every vertex of the graph exactly once
+    long long weight = 0; // weight of the closed tour, 0 if some vertex is out of range
+    long long heavy_edges = 0; // edges of weight 2 in the closed tour
+};
+
+/**
+ * Weight, number of heavy edges and validity of a tour in one pass over it
+ *
+ * Seen vertexes are marked in a bitset, which is kept between calls.
+ * For dense storage edges are read by AVX2 gathers of 64-bit words of the bit matrix, four edges at a time,
+ * if the processor supports it, otherwise and for sparse storage (lists of light neighbours, nothing to gather)
+ * by scalar code. Result is the same on every path.
+ */
+class TourEvaluator {
+public:
+    /**
+     * @param vectorized - use AVX2, if the processor supports it
+     */
+    explicit TourEvaluator(bool vectorized = true) : vectorized(vectorized && HasAvx2()) {}
+
+    TourEvaluation Evaluate(const Graph &graph, const vector<int> &tour) {
+        TourEvaluation result;
+        int n = graph.Size();
+        size_t size = tour.size();
+        seen.assign((static_cast<size_t>(n) + 63) / 64, 0);
+        uint64_t repeated = 0;
+        long long light_edges = 0;
+
+        size_t i = 0;
+#ifdef HELLOWORLD_TOUREVALUATOR_AVX2
+        if (vectorized && graph.IsDense()) {
+            i = EvaluateDense(graph.GetLightEdges(), tour, repeated, light_edges);
+        }
+#endif
+        for (; i < size; ++i) {
+            int from = tour[i];
+            int to = tour[i + 1 == size ? 0 : i + 1];
+            if (static_cast<unsigned>(from) >= static_cast<unsigned>(n) ||
+                static_cast<unsigned>(to) >= static_cast<unsigned>(n)) {
+                return result;
+            }
+            repeated |= Mark(from);
+            light_edges += graph.GetEdgeWeight(from, to) == LIGHT_EDGE;
+        }
+
+        result.valid = size == static_cast<size_t>(n) && repeated == 0;
+        result.heavy_edges = size - light_edges;
+        result.weight = LIGHT_EDGE * light_edges + HEAVY_EDGE * result.heavy_edges;
+        return result;
+    }
+
+    static bool HasAvx2() {
+#ifdef HELLOWORLD_TOUREVALUATOR_AVX2
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        return has_avx2;
+#else
+        return false;
+#endif
+    }
+
+private:
+    /**
+     * Marks vertex as seen
+     * @return non-zero if it was seen before
+     */
+    uint64_t Mark(int vertex) {
+        uint64_t bit = 1ULL << (vertex & 63);
+        uint64_t &word = seen[vertex >> 6];
+        uint64_t repeated = word & bit;
+        word |= bit;
+        return repeated;
+    }
+
+#ifdef HELLOWORLD_TOUREVALUATOR_AVX2
+    /**
+     * Evaluates edges (tour[i], tour[i + 1]) by blocks of four, while both ends of the block are in the tour
+     * and in range of the matrix
+     * @return index of the first edge, which is not evaluated
+     */
+    __attribute__((target("avx2")))
+    size_t EvaluateDense(const BitMatrix &matrix, const vector<int> &tour, uint64_t &repeated,
+                         long long &light_edges) {
+        const auto *words = reinterpret_cast<const long long *>(matrix.Row(0));
+        const __m128i last_vertex = _mm_set1_epi32(matrix.Size() - 1);
+        const __m128i zero = _mm_setzero_si128();
+        const __m256i words_per_row = _mm256_set1_epi64x(matrix.WordsPerRow());
+        const __m256i low_bits = _mm256_set1_epi64x(63);
+        const __m256i one = _mm256_set1_epi64x(1);
+        __m256i light = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 4 < tour.size(); i += 4) {
+            __m128i from = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tour.data() + i));
+            __m128i to = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tour.data() + i + 1));
+            __m128i out_of_range = _mm_or_si128(
+                    _mm_or_si128(_mm_cmplt_epi32(from, zero), _mm_cmpgt_epi32(from, last_vertex)),
+                    _mm_or_si128(_mm_cmplt_epi32(to, zero), _mm_cmpgt_epi32(to, last_vertex)));
+            if (!_mm_testz_si128(out_of_range, out_of_range)) {
+                // scalar code finds the wrong vertex
+                break;
+            }
+
+            __m256i from_64 = _mm256_cvtepi32_epi64(from);
+            __m256i to_64 = _mm256_cvtepi32_epi64(to);
+            __m256i index = _mm256_add_epi64(_mm256_mul_epu32(from_64, words_per_row), _mm256_srli_epi64(to_64, 6));
+            __m256i word = _mm256_i64gather_epi64(words, index, sizeof(uint64_t));
+            light = _mm256_add_epi64(light, _mm256_and_si256(
+                    _mm256_srlv_epi64(word, _mm256_and_si256(to_64, low_bits)), one));
+
+            // marking is scalar: AVX2 has no scatter and no conflict detection
+            repeated |= Mark(tour[i]) | Mark(tour[i + 1]) | Mark(tour[i + 2]) | Mark(tour[i + 3]);
+        }
+
+        alignas(32) long long sums[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sums), light);
+        light_edges += sums[0] + sums[1] + sums[2] + sums[3];
+        return i;
+    }
+#endif
+
+    bool vectorized;
+    vector<uint64_t> seen; // bit per vertex
+};
+
+
+#endif //HELLOWORLD_TOUREVALUATOR_H
@@ -0,0 +1,91 @@
+//
+// Created by artyom on 31/12/20.
+//
+
+#ifndef HELLOWORLD_UNIONFIND_H
+#define HELLOWORLD_UNIONFIND_H
+
+#pragma once
+
+#include <vector>
+#include <numeric>
+#include "IndexArray.h"
+
+using std::vector;
+
+/**
+ * Disjoint sets of elements 0..n-1 with path compression and union by size
+ * Each set has a label - element, which names the set regardless of which element is the root of the tree
+ * Index - type of stored elements and sizes (see IndexArray.h), it must fit n
+ */
+template<typename Index>
+class BasicUnionFind {
+public:
+    BasicUnionFind() = default;
+
+    explicit BasicUnionFind(int n) {
+        Reset(n);
+    }
+
+    /**
+     * Makes n sets of one element, memory of previous sets is reused
+     */
+    void Reset(int n) {
+        parent.resize(n);
+        size.assign(n, 1);
+        label.resize(n);
+        std::iota(parent.begin(), parent.end(), 0);
+        std::iota(label.begin(), label.end(), 0);
+    }
+
+    /**
+     * @return root of the tree, which contains element
+     */
+    int Find(int element) {
+        int root = element;
+        while (parent[root] != root) {
+            root = parent[root];
+        }
+        while (parent[element] != root) {
+            int next = parent[element];
+            parent[element] = root;
+            element = next;
+        }
+        return root;
+    }
+
+    /**
+     * Joins sets of first and second elements, joined set gets label of the set of the first element
+     */
+    void Union(int first, int second) {
+        int first_root = Find(first);
+        int second_root = Find(second);
+        if (first_root == second_root) {
+            return;
+        }
+        int joined_label = label[first_root];
+        if (size[first_root] < size[second_root]) {
+            std::swap(first_root, second_root);
+        }
+        parent[second_root] = first_root;
+        size[first_root] += size[second_root];
+        label[first_root] = joined_label;
+    }
+
+    /**
+     * @return label of the set, which contains element
+     */
+    int GetLabel(int element) {
+        return label[Find(element)];
+    }
+
+private:
+    vector<Index> parent;
+    vector<Index> size;
+    vector<Index> label;
+};
+
+using UnionFind = BasicUnionFind<int>;
+
+
+#endif //HELLOWORLD_UNIONFIND_H
@@ -0,0 +1,421 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
+#include "CountingNew.h"
+#include "TSPApproximation.h"
+#include "InstanceFile.h"
+#include "MatrixFile.h"
+#include "IncrementalApproximation.h"
+#include "Solver.h"
+#include "TourEvaluator.h"
+#include "InstanceGenerator.h"
+
+using std::vector;
+using std::pair;
+using std::string;
+using std::cout;
+using std::endl;
+
+/**
+ * @param family - structure of the instance, every family is given a cover of cycles
+ * @param num_vertexes - number of vertexes in a graph
+ * @param cycle_length - average length of a cycle
+ * @param heavy_percent - percent of heavy edges in cycles
+ * @param extra_degree - average number of random light edges for each vertex
+ * @param seed - seed of random generator, the same seed gives the same instance
+ */
+GeneratorOptions InstanceOptions(InstanceFamily family, int num_vertexes, int cycle_length, int heavy_percent,
+                                 int extra_degree, uint64_t seed) {
+    GeneratorOptions options;
+    options.family = family;
+    options.num_vertexes = num_vertexes;
+    options.seed = seed;
+    options.cycle_length = cycle_length;
+    options.num_cycles = num_vertexes / std::max(cycle_length, 4);
+    options.heavy_percent = heavy_percent;
+    options.extra_degree = extra_degree;
+    return options;
+}
+
+/**
+ * Random directed graph, in which every vertex has no more than one incoming edge:
+ * random trees, half of which are closed in a cycle through the root
+ */
+template<typename Index>
+BasicDirectedGraph<Index> GenerateDirectedGraph(int num_vertexes, int tree_size, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    vector<int> permutation(num_vertexes);
+    for (int i = 0; i < num_vertexes; ++i) {
+        permutation[i] = i;
+    }
+    std::shuffle(permutation.begin(), permutation.end(), random);
+
+    BasicDirectedGraph<Index> directed_graph;
+    for (int begin = 0; begin < num_vertexes; begin += tree_size) {
+        int end = std::min(num_vertexes, begin + tree_size);
+        for (int i = begin + 1; i < end; ++i) {
+            int parent = begin + static_cast<int>(random() % (i - begin));
+            directed_graph.AddEdge(permutation[parent], permutation[i]);
+        }
+        if (end - begin > 1 && random() % 2 == 0) {
+            directed_graph.AddEdge(permutation[end - 1], permutation[begin]);
+        }
+    }
+    return directed_graph;
+}
+
+struct Result {
+    string name;
+    int repetitions;
+    double nanoseconds;
+    double items;
+    double allocations;
+    double allocated_bytes;
+};
+
+/**
+ * Runs setup and then measures run on the state returned by setup, repetitions times
+ * @param items - number of processed items in one run, for throughput
+ */
+template<typename Setup, typename Run>
+Result Measure(const string &name, int repetitions, double items, Setup setup, Run run) {
+    Result result{name, repetitions, 0, items, 0, 0};
+    for (int i = 0; i < repetitions; ++i) {
+        auto state = setup();
+        uint64_t allocations = AllocationCounter::Allocations();
+        uint64_t allocated_bytes = AllocationCounter::AllocatedBytes();
+        auto start = std::chrono::steady_clock::now();
+        run(*state);
+        auto finish = std::chrono::steady_clock::now();
+        result.nanoseconds += std::chrono::duration<double, std::nano>(finish - start).count();
+        result.allocations += AllocationCounter::Allocations() - allocations;
+        result.allocated_bytes += AllocationCounter::AllocatedBytes() - allocated_bytes;
+    }
+    result.nanoseconds /= repetitions;
+    result.allocations /= repetitions;
+    result.allocated_bytes /= repetitions;
+    return result;
+}
+
+void Print(const Result &result) {
+    cout << std::left << std::setw(24) << result.name << std::right
+         << std::setw(8) << result.repetitions
+         << std::setw(16) << std::fixed << std::setprecision(0) << result.nanoseconds
+         << std::setw(16) << std::setprecision(0) << result.items / (result.nanoseconds / 1e9)
+         << std::setw(14) << std::setprecision(1) << result.allocations
+         << std::setw(16) << std::setprecision(0) << result.allocated_bytes << endl;
+}
+
+/**
+ * Runs phases of TSPApproximation one by one, so that each of them can be measured in isolation
+ * Index - index type of the approximation, which TSPApproximation picks for the instance (see DispatchIndex)
+ */
+template<typename Index>
+class PhaseBenchmark {
+    using Approximation = BasicTSPApproximation<Index>;
+    using BipartiteGraph = BasicBipartiteGraph<Index>;
+    using DirectedGraph = BasicDirectedGraph<Index>;
+
+public:
+    PhaseBenchmark(const GeneratedInstance &instance, const GeneratorOptions &generator_options, int repetitions,
+                   const ApproximationOptions &options)
+            : instance(instance), generator_options(generator_options), seed(generator_options.seed),
+              repetitions(repetitions), options(options) {}
+
+    void Run() {
+        cout << std::left << std::setw(24) << "phase" << std::right << std::setw(8) << "reps"
+             << std::setw(16) << "ns/op" << std::setw(16) << "items/s"
+             << std::setw(14) << "allocs/op" << std::setw(16) << "bytes/op" << endl;
+
+        int n = instance.num_vertexes;
+        double m = instance.light_edges.size();
+
+        Print(Measure("generate", repetitions, n, [] {
+            return std::make_unique<int>(0);
+        }, [&](int &) {
+            auto generator_options_with_threads = generator_options;
+            generator_options_with_threads.threads = options.threads;
+            InstanceGenerator::Generate(generator_options_with_threads);
+        }));
+
+        Print(Measure("graph/sparse", repetitions, m, [] {
+            return std::make_unique<int>(0);
+        }, [&](int &) {
+            auto graph = Graph::FromLightEdges(n, instance.light_edges);
+        }));
+
+        if (n <= MAX_DENSE_VERTEXES) {
+            Print(Measure("graph/dense", repetitions, m, [] {
+                return std::make_unique<int>(0);
+            }, [&](int &) {
+                Graph graph(n);
+                for (const auto &edge: instance.light_edges) {
+                    graph.AddEdge(edge.first, edge.second, LIGHT_EDGE);
+                }
+            }));
+        }
+
+        Print(Measure("cycles/add", repetitions, n, [&] {
+            return Create();
+        }, [&](Approximation &approximation) {
+            approximation.AddCycles(instance.cycles);
+        }));
+
+        Print(Measure("cycles/join-bad", repetitions, n, [&] {
+            auto approximation = Create();
+            approximation->AddCycles(instance.cycles);
+            return approximation;
+        }, [&](Approximation &approximation) {
+            approximation.JoinBadCycles();
+            approximation.JoinGoodCyclesConnectedWithBadCycle();
+        }));
+
+        Print(Measure("bipartite/build", repetitions, m, [&] {
+            return PrepareUntilBipartiteGraph();
+        }, [&](Approximation &approximation) {
+            approximation.BuildBipartiteGraph(bad_cycle_idx);
+        }));
+
+        Print(Measure("bipartite/matching", repetitions, m, [&] {
+            auto approximation = PrepareUntilBipartiteGraph();
+            bipartite_graph = std::make_unique<BipartiteGraph>(approximation->BuildBipartiteGraph(bad_cycle_idx));
+            return approximation;
+        }, [&](Approximation &) {
+            bipartite_graph->FindOptimalMatching();
+        }));
+
+        vector<pair<int, pair<int, int>>> matching;
+        Print(Measure("bipartite/greedy", repetitions, m, [&] {
+            auto approximation = PrepareUntilBipartiteGraph();
+            bipartite_graph = std::make_unique<BipartiteGraph>(approximation->BuildBipartiteGraph(bad_cycle_idx));
+            return approximation;
+        }, [&](Approximation &) {
+            bipartite_graph->FindGreedyMatching(matching, std::max(options.matching_phases, 0));
+        }));
+
+        int num_cycles = instance.cycles.size();
+        Print(Measure("directed/components", repetitions, num_cycles, [&] {
+            return std::make_unique<DirectedGraph>(GenerateDirectedGraph<Index>(num_cycles, TREE_SIZE, seed));
+        }, [&](DirectedGraph &directed_graph) {
+            for (auto start_vertex: directed_graph.FindComponents()) {
+                directed_graph.FindCycle(start_vertex);
+            }
+        }));
+
+        Print(Measure("split/components", repetitions, num_cycles, [&] {
+            auto approximation = PrepareUntilBipartiteGraph();
+            approximation->MatchCycles(approximation->BuildBipartiteGraph(bad_cycle_idx));
+            return approximation;
+        }, [&](Approximation &approximation) {
+            approximation.SplitDirectedGraph();
+        }));
+
+        Print(Measure("join/all", repetitions, num_cycles, [&] {
+            auto approximation = Create();
+            approximation->AddCycles(instance.cycles);
+            return approximation;
+        }, [&](Approximation &approximation) {
+            approximation.JoinRemainingCycles(approximation.approximation);
+        }));
+
+        Print(Measure("total", repetitions, n, [] {
+            return std::make_unique<int>(0);
+        }, [&](int &) {
+            TSPApproximation approximation(n, instance.light_edges, instance.cycles, options);
+        }));
+
+        auto graph = Graph::FromLightEdges(n, instance.light_edges);
+        vector<int> cycle_offsets;
+        vector<int> cycle_vertexes;
+        auto cycles = Approximation::Flatten(instance.cycles, cycle_offsets, cycle_vertexes);
+        vector<int> tour;
+        Print(Measure("solver/reuse", repetitions, n, [&] {
+            auto solver = std::make_unique<Solver>(options);
+            for (int i = 0; i < WARM_UP_SOLVES; ++i) {
+                solver->Solve(graph, cycles, tour);
+            }
+            return solver;
+        }, [&](Solver &solver) {
+            solver.Solve(graph, cycles, tour);
+        }));
+
+        Print(Measure("evaluate/sparse", repetitions, n, [] {
+            return std::make_unique<TourEvaluator>();
+        }, [&](TourEvaluator &evaluator) {
+            evaluator.Evaluate(graph, tour);
+        }));
+
+        if (n <= MAX_DENSE_VERTEXES) {
+            Graph dense_graph(n);
+            for (const auto &edge: instance.light_edges) {
+                dense_graph.AddEdge(edge.first, edge.second, LIGHT_EDGE);
+            }
+            Print(Measure("evaluate/dense-scalar", repetitions, n, [] {
+                return std::make_unique<TourEvaluator>(false);
+            }, [&](TourEvaluator &evaluator) {
+                evaluator.Evaluate(dense_graph, tour);
+            }));
+            Print(Measure("evaluate/dense", repetitions, n, [] {
+                return std::make_unique<TourEvaluator>();
+            }, [&](TourEvaluator &evaluator) {
+                evaluator.Evaluate(dense_graph, tour);
+            }));
+        }
+
+        if (n <= MAX_MAPPED_VERTEXES) {
+            RunMapped(graph, cycles);
+        }
+
+        vector<EdgeUpdate> updates = GenerateUpdates();
+        Print(Measure("incremental/update", repetitions, updates.size(), [&] {
+            return std::make_unique<IncrementalApproximation>(
+                    Graph::FromLightEdges(n, instance.light_edges), options);
+        }, [&](IncrementalApproximation &approximation) {
+            approximation.Update(updates);
+        }));
+
+        SolveStats stats;
+        auto stats_options = options;
+        stats_options.stats = &stats;
+        stats_options.compare_matching = true;
+        TSPApproximation approximation(n, instance.light_edges, instance.cycles, stats_options);
+        cout << "stats of one solve: " << stats.ToJson() << endl;
+    }
+
+private:
+    const static int MAX_DENSE_VERTEXES = 50000;
+    const static int MAX_MAPPED_VERTEXES = 20000; // the matrix file takes n * n / 8 bytes
+    const static int TREE_SIZE = 16;
+    const static int UPDATE_BATCH = 300;
+    const static int WARM_UP_SOLVES = 2;
+
+    /**
+     * Writes the graph to a MatrixFile in the working directory, measures solves on the mapped matrix
+     * and checks that the tour is the same as the tour of the same matrix in memory
+     * local_search_ms is ignored here, because a search limited by time may stop at different tours
+     * throws std::runtime_error if the tours differ
+     */
+    void RunMapped(const Graph &graph, const FlatCycles &cycles) {
+        auto mapped_options = options;
+        mapped_options.local_search_ms = 0;
+        string path = "benchmark-" + std::to_string(getpid()) + ".matrix";
+        MatrixFile::Write(path, graph);
+        vector<int> mapped_tour;
+        Print(Measure("total/mapped", repetitions, instance.num_vertexes, [&] {
+            return std::make_unique<MatrixFile>(MatrixFile::Open(path));
+        }, [&](MatrixFile &file) {
+            auto mapped_graph = file.GetGraph();
+            mapped_tour = TSPApproximation(mapped_graph, cycles, mapped_options).GetApproximation();
+        }));
+        std::remove(path.c_str());
+
+        Graph dense_graph(instance.num_vertexes);
+        for (const auto &edge: instance.light_edges) {
+            dense_graph.AddEdge(edge.first, edge.second, LIGHT_EDGE);
+        }
+        if (TSPApproximation(dense_graph, cycles, mapped_options).GetApproximation() != mapped_tour) {
+            throw std::runtime_error("tour of the mapped matrix differs from the tour of the matrix in memory");
+        }
+        cout << "tour of the mapped matrix is the same as in memory" << endl;
+    }
+
+    /**
+     * @return UPDATE_BATCH random pairs of vertexes, which flip their weight
+     */
+    vector<EdgeUpdate> GenerateUpdates() const {
+        std::mt19937_64 random(seed);
+        std::uniform_int_distribution<int> vertex(0, instance.num_vertexes - 1);
+        auto graph = Graph::FromLightEdges(instance.num_vertexes, instance.light_edges);
+        vector<EdgeUpdate> updates;
+        while (updates.size() < UPDATE_BATCH) {
+            int first = vertex(random);
+            int second = vertex(random);
+            if (first != second) {
+                updates.push_back({first, second, LIGHT_EDGE + HEAVY_EDGE - graph.GetEdgeWeight(first, second)});
+            }
+        }
+        return updates;
+    }
+
+    std::unique_ptr<Approximation> Create() {
+        auto approximation = std::unique_ptr<Approximation>(
+                new Approximation(Graph::FromLightEdges(instance.num_vertexes, instance.light_edges)));
+        approximation->options = options;
+        return approximation;
+    }
+
+    std::unique_ptr<Approximation> PrepareUntilBipartiteGraph() {
+        auto approximation = Create();
+        approximation->AddCycles(instance.cycles);
+        approximation->JoinBadCycles();
+        bad_cycle_idx = approximation->JoinGoodCyclesConnectedWithBadCycle();
+        return approximation;
+    }
+
+    const GeneratedInstance &instance;
+    GeneratorOptions generator_options;
+    uint64_t seed;
+    int repetitions;
+    ApproximationOptions options;
+    int bad_cycle_idx = -1;
+    std::unique_ptr<BipartiteGraph> bipartite_graph;
+};
+
+/**
+ * Usage:
+ * benchmark [num_vertexes] [seed] [repetitions] [cycle_length] [heavy_percent] [extra_degree] [threads] [local_search_ms]
+ * [family] [matching_phases]
+ * benchmark --write path [num_vertexes] [seed] [cycle_length] [heavy_percent] [extra_degree] [family] - writes
+ * generated instance to InstanceFile
+ * family is planted, cover (default), clustered or trees, see InstanceGenerator::ParseFamily
+ * matching_phases - see ApproximationOptions, -1 (default) - maximum matching,
+ * row bipartite/greedy is measured with max(matching_phases, 0) phases
+ * row total/mapped solves the instance from a MatrixFile written to the working directory (up to 20000 vertexes)
+ * and exits with an exception, if its tour differs from the tour of the matrix in memory
+ */
+int main(int argc, char **argv) {
+    if (argc > 2 && string(argv[1]) == "--write") {
+        int num_vertexes = argc > 3 ? strtol(argv[3], nullptr, 10) : 100000;
+        uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
+        int cycle_length = argc > 5 ? strtol(argv[5], nullptr, 10) : 8;
+        int heavy_percent = argc > 6 ? strtol(argv[6], nullptr, 10) : 5;
+        int extra_degree = argc > 7 ? strtol(argv[7], nullptr, 10) : 2;
+        auto family = InstanceGenerator::ParseFamily(argc > 8 ? argv[8] : "cover");
+        auto generator_options = InstanceOptions(family, num_vertexes, cycle_length, heavy_percent, extra_degree, seed);
+        generator_options.threads = 0;
+        auto instance = InstanceGenerator::Generate(generator_options);
+        InstanceFile::Write(argv[2], Graph::FromLightEdges(num_vertexes, instance.light_edges), instance.cycles);
+        return 0;
+    }
+
+    int num_vertexes = argc > 1 ? strtol(argv[1], nullptr, 10) : 100000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+    int repetitions = argc > 3 ? strtol(argv[3], nullptr, 10) : 5;
+    int cycle_length = argc > 4 ? strtol(argv[4], nullptr, 10) : 8;
+    int heavy_percent = argc > 5 ? strtol(argv[5], nullptr, 10) : 5;
+    int extra_degree = argc > 6 ? strtol(argv[6], nullptr, 10) : 2;
+    ApproximationOptions options;
+    options.threads = argc > 7 ? strtol(argv[7], nullptr, 10) : 1;
+    options.local_search_ms = argc > 8 ? strtod(argv[8], nullptr) : 0;
+    auto family = InstanceGenerator::ParseFamily(argc > 9 ? argv[9] : "cover");
+    options.matching_phases = argc > 10 ? strtol(argv[10], nullptr, 10) : -1;
+
+    auto generator_options = InstanceOptions(family, num_vertexes, cycle_length, heavy_percent, extra_degree, seed);
+    auto instance = InstanceGenerator::Generate(generator_options);
+    cout << "vertexes: " << num_vertexes << ", light edges: " << instance.light_edges.size()
+         << ", cycles: " << instance.cycles.size() << ", seed: " << seed << endl;
+
+    DispatchIndex(num_vertexes, [&](auto index) {
+        PhaseBenchmark<decltype(index)> benchmark(instance, generator_options, repetitions, options);
+        benchmark.Run();
+    });
+}
@@ -3,8 +3,18 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cassert>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
 #include "DirectedGraph.h"
 #include "TSPApproximation.h"
+#include "ThreadPool.h"
+#include "InstanceFile.h"
+#include "TSPLIBReader.h"
+#include "TourEvaluator.h"
+#include "InstanceGenerator.h"
 #include <cstdlib>
 
 using std::vector;
@@ -15,190 +25,235 @@ using std::cout;
 using std::endl;
 
 /**
+ * Function to test accuracy of approximation
+ * generates graph with a planted tour: random permutation of vertexes, some edges of which have weight 1,
+ * other edges of the graph have weight 2
+ *
+ * calc weight of the planted tour
+ * than calc approximation and its weight
  *
- * @param n - length of a permutation
- * @return random permutation of length n
+ * calc accuracy as weight_of_approximation/weight_of_planted_tour
+ *
+ * @param num_vertexes - number of vertexes in a graph
+ * @param num_cycles - number of cycles on which the planted tour is split to calc approximation,
+ * cycles weigh as much as the tour, if 0 - approximation finds cycles by itself with the experimental heuristic
+ * (see CycleCover), and accuracy may be worse than 7/6
+ * @param num_good_edges - number of edges of weight 1 in the planted tour
+ * @param proportion - if >0 than every other pair of vertexes has weight 1 with probability proportion percents
+ * @param seed - seed of InstanceGenerator, the same seed gives the same graph
+ * @return accuracy of approximation
+ * throws std::runtime_error with the seed if the approximation is not a tour
  */
-vector<int> RandomPermutation(int n) {
-    vector<int> permutation(n);
-    for (int i = 0; i < n; ++i) {
-        permutation[i] = i;
+double Test(int num_vertexes, int num_cycles, int num_good_edges, int proportion, uint64_t seed) {
+    assert(num_good_edges <= num_vertexes);
+    GeneratorOptions generator_options;
+    generator_options.family = InstanceFamily::PLANTED_TOUR;
+    generator_options.num_vertexes = num_vertexes;
+    generator_options.seed = seed;
+    generator_options.heavy_percent = 100.0 * (num_vertexes - num_good_edges) / num_vertexes;
+    generator_options.extra_degree = 0;
+    generator_options.density_percent = std::max(proportion, 0);
+    generator_options.num_cycles = num_cycles;
+    auto instance = InstanceGenerator::Generate(generator_options);
+    auto graph = Graph::FromLightEdges(num_vertexes, instance.light_edges);
+
+    TourEvaluator evaluator;
+    double real_weight = evaluator.Evaluate(graph, instance.planted_tour).weight;
+    //cout << "Real weight: " <<  real_weight << endl;
+
+    vector<int> approximation;
+    if (num_cycles == 0) {
+        TSPApproximation tspApproximation(num_vertexes, instance.light_edges);
+        approximation = tspApproximation.GetApproximation();
+    } else {
+        TSPApproximation tspApproximation(num_vertexes, instance.light_edges, instance.cycles);
+        approximation = tspApproximation.GetApproximation();
     }
-    for (int i = n - 1; i > 0; i--) {
-        int j = rand() % i;
-        std::swap(permutation[i], permutation[j]);
+    auto evaluation = evaluator.Evaluate(graph, approximation);
+    if (!evaluation.valid) {
+        throw std::runtime_error("approximation is not a tour, seed " + std::to_string(seed));
     }
-    return permutation;
+    //cout << "Approximation weight: " << evaluation.weight << endl;
+
+    return evaluation.weight / real_weight;
 }
 
 /**
- *
- * @param edges - edges of a graph
- * @param cycle - cycle, for which we calc weight
- * @return weight of a cycle in a graph
+ * Point of a grid of parameters of Test
  */
-int CalcWeight(const vector<vector<int>>& edges, vector<int> cycle) {
-    int res = 0;
-    for (int i = 0; i < cycle.size(); ++i) {
-        res += edges[cycle[i]][cycle[(i + 1) % cycle.size()]];
-    }
-    return res;
+struct TestParameters {
+    int num_vertexes;
+    int num_cycles;
+    int num_good_edges;
+    int proportion;
+};
+
+/**
+ * Accuracies of all repetitions of one point of a grid
+ */
+struct SweepCell {
+    TestParameters parameters;
+    double min_accuracy;
+    double mean_accuracy;
+    double max_accuracy;
+};
+
+/**
+ * @return seed of Test of the repetition of the point of a sweep, a failed test is repeated by
+ * helloworld num_vertexes num_cycles num_good_edges proportion seed
+ */
+uint64_t TestSeed(uint64_t seed, int point, int repetition) {
+    return CounterRandom(seed, point).At(repetition);
 }
 
 /**
+ * Runs Test for every point of a grid repetitions times on a pool of threads
  *
- * Split 'cycles' on two cycles while cycles.size() les than num_cycles
- * and change weight of new edges added to cycles such that new weight of
- * cycles is equal to previous weight
+ * Each repetition has its own instance seeded by TestSeed(seed, point, repetition),
+ * so results don't depend on the number of threads and the order of execution
  *
- * @param cycles - result vector of cycles
- * @param num_cycles - number of cycles
- * @param edges - edges of a graph
+ * @param on_cell - called with SweepCell as soon as all repetitions of a point are finished,
+ * calls are serialized, points come in the order of completion
  */
-void SplitCycles(vector<vector<int>>& cycles, int num_cycles, vector<vector<int>>& edges) {
-    while (cycles.size() < num_cycles) {
-        int cycle_num = rand() % cycles.size();
-        auto cycle = cycles[cycle_num];
-        while (cycle.size() < 8) {
-            cycle_num = (cycle_num + 1) % cycles.size();
-            cycle = cycles[cycle_num];
-        }
-        if (cycle.size() < 8) {
-            cout << "No cycles with length more than 7, can't split any cycle" << endl;
-            return;
-        }
-
-        int first = rand() % cycle.size();
-        int length = 4;
-        if (cycle.size() > 8) {
-            length += rand() % (cycle.size() - 8);
-        }
-        int second = (first + length) % cycle.size();
-
-        vector<int> first_cycle;
-        vector<int> second_cycle;
-
-        int first_end = -1;
-        int second_end = -1;
-
-        if (first < second) {
-            first_end = second - 1;
-            second_end = first - 1;
-            if (second_end < 0) {
-                second_end = cycle.size() - 1;
-            }
-            first_cycle = vector<int>(cycle.begin() + first, cycle.begin() + second);
-            second_cycle.reserve( cycle.size() - first_cycle.size());
-            second_cycle.insert( second_cycle.end(), cycle.begin() + second, cycle.end());
-            if (first > 0) {
-                second_cycle.insert( second_cycle.end(), cycle.begin(), cycle.begin() + first);
-            }
+template<typename OnCell>
+void Sweep(const vector<TestParameters> &grid, int repetitions, int num_threads, uint64_t seed, OnCell on_cell) {
+    vector<vector<double>> accuracies(grid.size(), vector<double>(repetitions));
+    vector<std::atomic<int>> remaining(grid.size());
+    for (auto &counter: remaining) {
+        counter = repetitions;
+    }
+    std::mutex output_mutex;
 
-        } else {
-            second_end = first - 1;
-            first_end = second - 1;
-            if (first_end < 0) {
-                first_end = cycle.size() - 1;
-            }
-            second_cycle = vector<int>(cycle.begin() + second, cycle.begin() + first);
-            first_cycle.reserve( cycle.size() - second_cycle.size());
-            first_cycle.insert( first_cycle.end(), cycle.begin() + first, cycle.end());
-            if (second > 0) {
-                first_cycle.insert( first_cycle.end(), cycle.begin(), cycle.begin() + second);
-            }
+    ThreadPool pool(num_threads);
+    for (int point = 0; point < static_cast<int>(grid.size()); ++point) {
+        for (int repetition = 0; repetition < repetitions; ++repetition) {
+            pool.Submit([&, point, repetition] {
+                const auto &parameters = grid[point];
+                accuracies[point][repetition] = Test(parameters.num_vertexes, parameters.num_cycles,
+                                                     parameters.num_good_edges, parameters.proportion,
+                                                     TestSeed(seed, point, repetition));
+                if (--remaining[point] == 0) {
+                    const auto &values = accuracies[point];
+                    SweepCell cell{parameters, *std::min_element(values.begin(), values.end()), 0,
+                                   *std::max_element(values.begin(), values.end())};
+                    for (double value: values) {
+                        cell.mean_accuracy += value / values.size();
+                    }
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    on_cell(cell);
+                }
+            });
         }
-
-        edges[cycle[first]][cycle[first_end]] = edges[cycle[second_end]][cycle[first]];
-        edges[cycle[first_end]][cycle[first]] = edges[cycle[second_end]][cycle[first]];
-        edges[cycle[second]][cycle[second_end]] = edges[cycle[first_end]][cycle[second]];
-        edges[cycle[second_end]][cycle[second]] = edges[cycle[first_end]][cycle[second]];
-
-        cycles[cycle_num] = first_cycle;
-        cycles.push_back(second_cycle);
     }
+    pool.Wait();
 }
 
 /**
- * Function to test accuracy of approximation
- * creates graph with edges of weight 2
- * choose random permutation of vertexes and
- * set weight of some edges by this permutation to 1
- *
- * calc weight of permutation
- * than calc approximation and its weight
- *
- * calc accuracy as weight_of_permutation/weight_of_approximation
- *
- * @param num_vertexes - number of vertexes in a graph
- * @param num_cycles - number of cycles on which permutation is split to calc approximation
- * @param num_good_edges - number of edges of weight 1 in permutation
- * @param proportion - if >0 than we change additional number of edges to 1 (proportion - number of percents)
+ * Prints usage of the command line (see main) to stderr
  */
-void Test(int num_vertexes, int num_cycles, int num_good_edges, int proportion) {
-    assert(num_good_edges <= num_vertexes);
-    vector<vector<int>> edges(num_vertexes);
-    vector<vector<int>> cycles(1);
-    for (auto &edge : edges) {
-        edge = vector<int>(num_vertexes, 2);
-    }
-    auto permutation = RandomPermutation(num_vertexes);
-    auto good_edges_indexes = RandomPermutation(num_vertexes);
-    for (int i = 0; i < num_good_edges; ++i) {
-        int ind_in_permutation = good_edges_indexes[i];
-        int left = permutation[ind_in_permutation];
-        int right = permutation[(ind_in_permutation + 1) % num_vertexes];
-        edges[left][right] = 1;
-        edges[right][left] = 1;
-    }
-    double real_weight = CalcWeight(edges, permutation);
-    //cout << "Real weight: " <<  real_weight << endl;
+void PrintUsage() {
+    std::cerr << "usage: helloworld num_vertexes num_cycles num_good_edges [proportion] [seed]" << endl
+              << "       helloworld --sweep [repetitions] [threads] [seed] < points" << endl
+              << "       helloworld --solve path [threads] [starts] [local_search_ms] [matching_phases]" << endl
+              << "       helloworld --tsplib path [threads] [starts] [local_search_ms] [matching_phases]" << endl
+              << "num_vertexes must be at least 4, num_cycles 0 - experimental cover without the guarantee of 7/6"
+              << endl;
+}
 
-    cycles[0] = permutation;
-    SplitCycles(cycles, num_cycles, edges);
+/**
+ * Usage:
+ * helloworld num_vertexes num_cycles num_good_edges [proportion] [seed] - prints accuracy of one test,
+ * proportion -1 - no additional edges of weight 1, num_cycles 0 - experimental cover (see Test)
+ * helloworld --sweep [repetitions] [threads] [seed] - reads points "num_vertexes num_cycles num_good_edges [proportion]"
+ * from stdin, one per line, and prints "num_vertexes num_cycles num_good_edges proportion min mean max"
+ * for every point as soon as it is finished
+ * helloworld --solve path [threads] [starts] [local_search_ms] [matching_phases] - solves instance from InstanceFile,
+ * checks the tour and prints its weight
+ * helloworld --tsplib path [threads] [starts] [local_search_ms] [matching_phases] - solves TSPLIB instance
+ * with weights 1 and 2, finds cycle cover by itself with the experimental CycleCover (so 7/6 is not guaranteed), checks the tour and prints its weight
+ * matching_phases - see ApproximationOptions, -1 (default) - maximum matching
+ * On invalid arguments (e.g. less than 4 vertexes) prints the error and usage and returns 1
+ */
+int main(int argc, char** argv) {
+    if (argc > 2 && (std::string(argv[1]) == "--solve" || std::string(argv[1]) == "--tsplib")) {
+        ApproximationOptions options;
+        options.threads = argc > 3 ? strtol(argv[3], nullptr, 10) : 1;
+        options.starts = argc > 4 ? strtol(argv[4], nullptr, 10) : 1;
+        options.local_search_ms = argc > 5 ? strtod(argv[5], nullptr) : 0;
+        options.matching_phases = argc > 6 ? strtol(argv[6], nullptr, 10) : -1;
 
-    if (proportion != -1) {
-        double num_all_good_edges = 0;
-        for (int i = 0; i < edges.size(); ++i) {
-            for (int j = 0; j < edges.size(); ++j) {
-                if (edges[i][j] == 1) {
-                    num_all_good_edges++;
-                }
-            }
+        vector<int> approximation;
+        TourEvaluation evaluation;
+        if (std::string(argv[1]) == "--solve") {
+            auto file = InstanceFile::Open(argv[2]);
+            auto graph = file.GetGraph();
+            TSPApproximation tspApproximation(graph, file.GetCycles(), options);
+            approximation = tspApproximation.GetApproximation();
+            evaluation = TourEvaluator().Evaluate(graph, approximation);
+        } else {
+            auto instance = TSPLIBReader::Read(argv[2]);
+            auto graph = Graph::FromLightEdges(instance.dimension, instance.light_edges);
+            instance.light_edges = {};
+            TSPApproximation tspApproximation(graph, options);
+            approximation = tspApproximation.GetApproximation();
+            evaluation = TourEvaluator().Evaluate(graph, approximation);
         }
-        int n = num_vertexes * num_vertexes;
-        if (num_all_good_edges / n < proportion / 100.) {
-            for (int i = 0; i < edges.size(); ++i) {
-                for (int j = 0; j < edges.size(); ++j) {
-                    if (num_all_good_edges / n >= proportion / 100.) {
-                        break;
-                    } else {
-                        if (edges[i][j] != 1) {
-                            edges[i][j] = 1;
-                            num_all_good_edges++;
-                        }
-                    }
-                }
-            }
+        if (!evaluation.valid) {
+            std::cerr << "tour is not a permutation of vertexes" << endl;
+            return 1;
         }
+        cout << evaluation.weight << endl;
+        return 0;
     }
 
-    TSPApproximation tspApproximation(edges, cycles);
-    vector<int> approximation = tspApproximation.GetApproximation();
-    double approximation_weight = CalcWeight(edges, approximation);
-    //cout << "Approximation weight: " << approximation_weight << endl;
+    if (argc > 1 && std::string(argv[1]) == "--sweep") {
+        int repetitions = argc > 2 ? strtol(argv[2], nullptr, 10) : 10;
+        int num_threads = argc > 3 ? strtol(argv[3], nullptr, 10) : 0;
+        uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : 1;
 
-    cout << approximation_weight / real_weight;
-}
+        vector<TestParameters> grid;
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            TestParameters parameters{0, 0, 0, -1};
+            if (sscanf(line.c_str(), "%d %d %d %d", &parameters.num_vertexes, &parameters.num_cycles,
+                       &parameters.num_good_edges, &parameters.proportion) >= 3) {
+                grid.push_back(parameters);
+            }
+        }
 
-int main(int argc, char** argv) {
+        try {
+            Sweep(grid, repetitions, num_threads, seed, [](const SweepCell &cell) {
+                cout << cell.parameters.num_vertexes << " " << cell.parameters.num_cycles << " "
+                     << cell.parameters.num_good_edges << " " << cell.parameters.proportion << " "
+                     << cell.min_accuracy << " " << cell.mean_accuracy << " " << cell.max_accuracy << endl;
+            });
+        } catch (const std::exception &exception) {
+            std::cerr << exception.what() << endl;
+            PrintUsage();
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc < 4) {
+        PrintUsage();
+        return 1;
+    }
     int num_vertexes = strtol(argv[1], nullptr, 10);
     int num_cycles = strtol(argv[2], nullptr, 10);
     int num_good_edges = strtol(argv[3], nullptr, 10);
 
     int proportion = -1;
-    if (argc == 5) {
+    if (argc >= 5) {
         proportion = strtol(argv[4], nullptr, 10);
     }
 
-    Test(num_vertexes, num_cycles, num_good_edges, proportion);
-}
\ No newline at end of file
+    uint64_t seed = argc > 5 ? strtoull(argv[5], nullptr, 10) : 1;
+    try {
+        cout << Test(num_vertexes, num_cycles, num_good_edges, proportion, seed);
+    } catch (const std::exception &exception) {
+        std::cerr << exception.what() << endl;
+        PrintUsage();
+        return 1;
+    }
+}